@@ -0,0 +1,486 @@
+/*
+ * Benchmarks for the firmware's message handling and ranging paths, run against the host
+ * simulation. Exits non-zero if a handler path allocates or the firmware asks for a reboot,
+ * so CI can catch regressions on every commit.
+ */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_wifi.h"
+#include "json_scan.h"
+#include "level_tracker.h"
+#include "metrics.h"
+#include "ranging.h"
+#include "reading_buffer.h"
+#include "runtime_config.h"
+#include "sim.h"
+#include "supervisor.h"
+
+#include "sdkconfig.h"
+
+#define SIM_TIME_SCALE 10000.0
+#define DEVICE_MANIFEST_TOPIC CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC "/dcda0cc1bb14"
+#define DEVICE_MAC "dc:da:0c:c1:bb:14"
+#define DEVICE_CONFIG_TOPIC CONFIG_SUBSCRIBE_CONFIG_TOPIC "/dcda0cc1bb14"
+
+typedef struct {
+    int64_t *latency_ns;
+    size_t count;
+    uint64_t allocs;
+    int64_t elapsed_ns;
+} bench_result_t;
+
+static int failures = 0;
+
+static int compare_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, bench_result_t *result, bool must_not_allocate) {
+    qsort(result->latency_ns, result->count, sizeof(int64_t), compare_i64);
+
+    double allocs_per_op = (double)result->allocs / result->count;
+    printf("%-28s %8zu %9lld %9lld %9lld %11.2f %12.0f\n", name, result->count,
+           (long long)result->latency_ns[result->count / 2], (long long)result->latency_ns[result->count * 99 / 100],
+           (long long)result->latency_ns[result->count - 1], allocs_per_op,
+           result->count * 1e9 / (double)result->elapsed_ns);
+
+    if (must_not_allocate && result->allocs > 0) {
+        printf("  FAIL: %s allocated %llu times\n", name, (unsigned long long)result->allocs);
+        failures++;
+    }
+    free(result->latency_ns);
+}
+
+static bench_result_t bench_begin(size_t count) {
+    bench_result_t result = {.latency_ns = calloc(count, sizeof(int64_t)), .count = count};
+    return result;
+}
+
+// Time one delivery per iteration; payload is picked by the iteration index
+static void bench_deliveries(const char *name, const char *const *topics, const char *const *payloads, size_t variants,
+                             size_t count) {
+    bench_result_t result = bench_begin(count);
+    int64_t start = sim_real_ns();
+
+    for (size_t i = 0; i < count; i++) {
+        const char *payload = payloads[i % variants];
+        uint64_t allocs = sim_alloc_count();
+        int64_t t0 = sim_real_ns();
+
+        if (!sim_broker_deliver(topics[i % variants], payload, strlen(payload))) {
+            printf("  FAIL: %s not delivered to %s\n", name, topics[i % variants]);
+            failures++;
+            break;
+        }
+        result.latency_ns[i] = sim_real_ns() - t0;
+        result.allocs += sim_alloc_count() - allocs;
+    }
+    result.elapsed_ns = sim_real_ns() - start;
+    report(name, &result, true);
+}
+
+// Cost of finding this bowl in the legacy MAC-keyed map, which grows with the fleet
+static void bench_fleet_map(size_t fleet, size_t count) {
+    size_t size = fleet * 96 + 64;
+    char *map = malloc(size);
+    size_t len = snprintf(map, size, "{");
+    char name[48];
+    json_span_t value;
+
+    for (size_t i = 0; i + 1 < fleet; i++) {
+        len += snprintf(map + len, size - len, "\"02:00:00:00:%02zx:%02zx\": \"https://bucket/bowl-%zu/firmware.bin\", ",
+                        i >> 8, i & 0xff, i);
+    }
+    len += snprintf(map + len, size - len, "\"" DEVICE_MAC "\": \"https://bucket/this-bowl/firmware.bin\"}");
+
+    bench_result_t result = bench_begin(count);
+    int64_t start = sim_real_ns();
+    for (size_t i = 0; i < count; i++) {
+        uint64_t allocs = sim_alloc_count();
+        int64_t t0 = sim_real_ns();
+        if (!json_scan_find(map, len, DEVICE_MAC, &value)) {
+            failures++;
+        }
+        result.latency_ns[i] = sim_real_ns() - t0;
+        result.allocs += sim_alloc_count() - allocs;
+    }
+    result.elapsed_ns = sim_real_ns() - start;
+
+    snprintf(name, sizeof(name), "fleet_map_scan/%zu", fleet);
+    report(name, &result, true);
+    free(map);
+}
+
+static void bench_ranging(size_t count) {
+    const sim_hcsr04_script_t script = {
+        .level_cm = 18.0f, .ripple_cm = 0.3f, .spike_probability = 0.15f, .timeout_probability = 0.05f};
+    bench_result_t result = bench_begin(count);
+    double error_sum = 0.0;
+    size_t rejected = 0;
+    float samples[RANGING_MAX_BURST];
+    ranging_result_t reading;
+
+    sim_hcsr04_set_script(&script);
+    int64_t start = sim_real_ns();
+    for (size_t i = 0; i < count; i++) {
+        for (size_t s = 0; s < CONFIG_RANGING_BURST_SAMPLES; s++) {
+            samples[s] = sim_hcsr04_sample();
+        }
+        uint64_t allocs = sim_alloc_count();
+        int64_t t0 = sim_real_ns();
+        bool ok = ranging_filter(samples, CONFIG_RANGING_BURST_SAMPLES, &reading);
+        result.latency_ns[i] = sim_real_ns() - t0;
+        result.allocs += sim_alloc_count() - allocs;
+
+        if (ok) {
+            double error = reading.distance_cm - script.level_cm;
+            error_sum += error < 0 ? -error : error;
+        } else {
+            rejected++;
+        }
+    }
+    result.elapsed_ns = sim_real_ns() - start;
+    report("ranging_filter", &result, true);
+    printf("  mean abs error %.3f cm over %zu bursts, %zu rejected\n", error_sum / (count - rejected), count - rejected,
+           rejected);
+}
+
+// Sleep for seconds of simulated time
+static void sleep_sim(uint32_t seconds) {
+    int64_t ns = (int64_t)(seconds * 1e9 / SIM_TIME_SCALE);
+    const struct timespec duration = {.tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000};
+
+    nanosleep(&duration, NULL);
+}
+
+static atomic_uint telemetry_readings;
+
+// Every reading in a telemetry payload carries a sequence number
+static void count_telemetry_readings(const char *topic, const char *payload, int len) {
+    const char *key = "\"seq\":";
+    size_t key_len = strlen(key);
+
+    if (strcmp(topic, CONFIG_PUBLISH_WATER_LEVEL_TOPIC) != 0) {
+        return;
+    }
+    for (int i = 0; i + (int)key_len <= len; i++) {
+        if (memcmp(payload + i, key, key_len) == 0) {
+            atomic_fetch_add(&telemetry_readings, 1);
+        }
+    }
+}
+
+// A member of one object in the metrics report, e.g. ("counters", "publish_ok") or ("publish_ack_ms", "n")
+static uint32_t report_value(const char *group, const char *name) {
+    char report[METRICS_REPORT_MAX];
+    json_span_t object, member;
+    uint32_t value = 0;
+
+    int len = metrics_format_report(report, sizeof(report));
+    if (len < (int)sizeof(report) && json_scan_find(report, len, group, &object) &&
+        json_scan_find(object.start, object.len, name, &member)) {
+        json_span_to_uint32(&member, &value);
+    }
+    return value;
+}
+
+// Return once the firmware has published nothing for a few simulated seconds
+static void wait_for_publishes_to_settle(void) {
+    uint32_t last = sim_broker_published_count(NULL);
+
+    for (int quiet = 0, polls = 0; quiet < 3 && polls < 10000; polls++) {
+        sleep_sim(1);
+        uint32_t now = sim_broker_published_count(NULL);
+        quiet = now == last ? quiet + 1 : 0;
+        last = now;
+    }
+}
+
+/*
+ * Take the broker away while the water level steps by more than the deadband, so every step queues readings,
+ * then check that reconnecting delivers each buffered reading exactly once and leaves the buffer empty.
+ */
+static void replay_outage(int steps) {
+    sim_hcsr04_script_t script = {.level_cm = 20.0f, .ripple_cm = 0.1f};
+    const float step_cm = CONFIG_PUBLISH_DEADBAND_MM / 10.0f * 2;
+
+    sim_hcsr04_set_script(&script);
+    sleep_sim(10 * 60); // Settle at the starting level while still connected
+    sim_broker_set_tap(count_telemetry_readings);
+
+    sim_broker_disconnect();
+    for (int i = 0; i < steps; i++) {
+        script.level_cm += step_cm;
+        sim_hcsr04_set_script(&script);
+        sleep_sim(2 * 60);
+    }
+    // Let the last step settle, so no reading is being queued while the buffer is counted
+    sleep_sim(10 * 60);
+
+    size_t buffered = reading_buffer_count();
+    uint32_t readings = atomic_load(&telemetry_readings);
+    uint32_t messages = sim_broker_published_count(CONFIG_PUBLISH_WATER_LEVEL_TOPIC);
+    uint32_t bytes = sim_broker_published_bytes(CONFIG_PUBLISH_WATER_LEVEL_TOPIC);
+    uint32_t publish_ok = report_value("counters", "publish_ok") + report_value("counters", "events");
+    uint32_t acked = report_value("counters", "publish_acked");
+    uint32_t timed = report_value("publish_ack_ms", "n");
+    sim_broker_connect();
+    for (int waited_ms = 0; reading_buffer_count() > 0 && waited_ms < 1000; waited_ms++) {
+        sleep_sim(10);
+    }
+    // PUBACK well inside the outbox expiry, so the firmware times every publish of the drain
+    wait_for_publishes_to_settle();
+    sim_broker_ack_pending();
+    readings = atomic_load(&telemetry_readings) - readings;
+    sim_broker_set_tap(NULL);
+
+    printf("outage_replay: %d level steps offline, %zu readings buffered, drained in %u publishes, %u bytes\n",
+           steps, buffered, sim_broker_published_count(CONFIG_PUBLISH_WATER_LEVEL_TOPIC) - messages,
+           sim_broker_published_bytes(CONFIG_PUBLISH_WATER_LEVEL_TOPIC) - bytes);
+    if (buffered < (size_t)steps || reading_buffer_count() != 0 || readings != buffered) {
+        printf("FAIL: %zu readings buffered, %u delivered, %zu left over\n", buffered, readings,
+               reading_buffer_count());
+        failures++;
+    }
+
+    // Level events are acknowledged publishes too
+    publish_ok = report_value("counters", "publish_ok") + report_value("counters", "events") - publish_ok;
+    acked = report_value("counters", "publish_acked") - acked;
+    timed = report_value("publish_ack_ms", "n") - timed;
+    if (acked != publish_ok || timed == 0) {
+        printf("FAIL: %u publishes, %u acknowledged, %u timed\n", publish_ok, acked, timed);
+        failures++;
+    }
+}
+
+// Poll the supervisor from the outside until its incident state matches open, for up to timeout_ms of wall time
+static bool wait_for_incident(bool open, int timeout_ms, supervisor_stats_t *stats) {
+    const struct timespec poll = {.tv_nsec = 100000};
+
+    for (int waited_us = 0; waited_us < timeout_ms * 1000; waited_us += 100) {
+        supervisor_get_stats(stats);
+        if (stats->open == open) {
+            return true;
+        }
+        nanosleep(&poll, NULL);
+    }
+    return false;
+}
+
+// Which step closed the incident, from the per-step counts before and after
+static const char *recovered_by(const supervisor_stats_t *before, const supervisor_stats_t *after) {
+    for (size_t i = 0; i < SUPERVISOR_STEP_COUNT; i++) {
+        if (after->recovered[i] != before->recovered[i]) {
+            return supervisor_step_name(i);
+        }
+    }
+    return "nothing";
+}
+
+// Faults that used to reboot the bowl: a malformed status message, then a silent status topic twice over, once
+// answered straight after the resubscribe and once only after the MQTT session is torn down and rebuilt
+static void replay_recovery(void) {
+    const struct timespec step = {.tv_nsec = (long)(CONFIG_SUPERVISOR_STEP_TIMEOUT_S * 1.5e9 / SIM_TIME_SCALE)};
+    const char *bad = "{\"LED\": 7}";
+    const char *good = "{\"LED\": \"green\"}";
+    supervisor_stats_t before, after;
+
+    supervisor_get_stats(&before);
+    sim_broker_deliver(CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, bad, strlen(bad));
+    wait_for_incident(false, 100, &after);
+    printf("recovery bad_message: %s\n", recovered_by(&before, &after));
+
+    for (int late = 0; late < 2; late++) {
+        supervisor_get_stats(&before);
+        sim_timer_fire("orphan_timer");
+        if (!wait_for_incident(true, 100, &after)) {
+            printf("FAIL: orphan fault opened no incident\n");
+            failures++;
+            return;
+        }
+        if (late) {
+            // Sit through the resubscribe step; the next one drops the session, which the broker then accepts
+            nanosleep(&step, NULL);
+            sim_broker_connect();
+        }
+        sim_broker_deliver(CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, good, strlen(good));
+        if (!wait_for_incident(false, 100, &after)) {
+            printf("FAIL: orphan incident still open\n");
+            failures++;
+            return;
+        }
+        printf("recovery orphan: %s in %lu ms\n", recovered_by(&before, &after),
+               (unsigned long)after.last_recovery_ms);
+    }
+}
+
+// Retune a running bowl over its config topic: what it costs on the wire, and that bad documents change nothing
+static void replay_config(void) {
+    const char *documents[] = {
+        "{\"version\": 1, \"interval_min_s\": 30, \"interval_max_s\": 900, \"orphan_timeout_s\": 3600, "
+        "\"led\": {\"RED\": {\"r\": 255, \"blink_ms\": 500}, \"GREEN\": {\"g\": 128}, \"BLACK\": {}}}",
+        "{\"version\": 1, \"interval_min_s\": 30, \"interval_max_s\": 900, \"orphan_timeout_s\": 3600, "
+        "\"led\": {\"RED\": {\"r\": 255, \"blink_ms\": 500}, \"GREEN\": {\"g\": 128}, \"BLACK\": {}}}",
+        "{\"version\": 2, \"interval_min_s\": 2}",
+        "{\"version\": 2, \"interval_mins\": 10}",
+        "{\"version\": 2, \"led\": {\"RED\": {\"r\": 255,}}}",
+        "{\"version\": 5, \"deadband_mm\": 8}",
+        "{\"version\": 4, \"deadband_mm\": 3}",
+    };
+    const size_t count = sizeof(documents) / sizeof(documents[0]);
+    const uint32_t expected_reports = count - 1; // All but the repeat of the version in effect
+    const char *reported = DEVICE_CONFIG_TOPIC "/reported";
+    uint32_t reports = sim_broker_published_count(reported);
+    size_t bytes_in = 0;
+    runtime_config_t config;
+
+    for (size_t i = 0; i < count; i++) {
+        sim_broker_deliver(DEVICE_CONFIG_TOPIC, documents[i], strlen(documents[i]));
+        bytes_in += strlen(documents[i]);
+    }
+    reports = sim_broker_published_count(reported) - reports;
+    runtime_config_get(&config);
+
+    printf("config_update: %u documents, %u bytes in, %u reports, %u bytes out; version %lu in effect, "
+           "interval %lu-%lu s, deadband %lu mm\n",
+           (unsigned)count, (unsigned)bytes_in, reports, sim_broker_published_bytes(reported),
+           (unsigned long)config.version, (unsigned long)config.interval_min_s, (unsigned long)config.interval_max_s,
+           (unsigned long)config.deadband_mm);
+    if (config.version != 5 || config.interval_min_s != 30 || config.deadband_mm != 8 || config.led_count != 3 ||
+        reports != expected_reports) {
+        printf("FAIL: config documents not applied as expected\n");
+        failures++;
+    }
+}
+
+// Reconnect on the pinned AP, then after the AP has moved, so the cached-AP fallback to a full scan runs too
+static void replay_wifi_reconnect(void) {
+    wifi_config_t config;
+
+    uint32_t pinned_ms = sim_wifi_reconnect();
+    esp_wifi_get_config(WIFI_IF_STA, &config);
+    bool pinned = config.sta.bssid_set;
+    sim_wifi_move_ap();
+    uint32_t fallback_ms = sim_wifi_reconnect();
+    uint32_t repinned_ms = sim_wifi_reconnect();
+    esp_wifi_get_config(WIFI_IF_STA, &config);
+
+    printf("wifi_reconnect: pinned %lu ms, AP moved %lu ms, pinned again %lu ms\n", (unsigned long)pinned_ms,
+           (unsigned long)fallback_ms, (unsigned long)repinned_ms);
+    if (!pinned || !config.sta.bssid_set || pinned_ms != SIM_WIFI_DIRECT_MS || fallback_ms < SIM_WIFI_SCAN_MS ||
+        repinned_ms != SIM_WIFI_DIRECT_MS) {
+        printf("FAIL: cached AP not pinned after a drop, or no full-scan fallback once it moved\n");
+        failures++;
+    }
+}
+
+// Scripted bowl: distance to the water in cm at t seconds into the day
+static float day_level_cm(uint32_t t) {
+    static const uint32_t drinks[] = {8 * 3600, 13 * 3600, 19 * 3600};
+    const uint32_t refill = 20 * 3600;
+    const float drink_cm = 1.5f;
+    const uint32_t drink_s = 60;
+    float level = 10.0f + 0.03f * t / 3600.0f; // Evaporation
+
+    for (size_t i = 0; i < sizeof(drinks) / sizeof(drinks[0]); i++) {
+        if (t >= drinks[i] + drink_s) {
+            level += drink_cm;
+        } else if (t > drinks[i]) {
+            level += drink_cm * (t - drinks[i]) / drink_s;
+        }
+    }
+    if (t >= refill + 30) {
+        level = 10.0f + 0.03f * (t - refill) / 3600.0f;
+    } else if (t > refill) {
+        level -= (level - 10.0f) * (t - refill) / 30.0f;
+    }
+    return level;
+}
+
+// Drive the level tracker through a scripted day and compare with a fixed-interval publisher
+static void replay_day(void) {
+    level_tracker_t tracker;
+    level_event_t events[LEVEL_TRACKER_MAX_EVENTS];
+    const uint32_t day_s = 24 * 3600;
+    uint32_t readings = 0;
+    uint32_t publishes = 0;
+
+    memset(&tracker, 0, sizeof(tracker));
+    level_tracker_init(&tracker);
+    srand(1);
+    for (uint32_t t = 0; t < day_s; t += level_tracker_interval_ms(&tracker) / 1000) {
+        reading_t reading = {
+            .seq = readings,
+            .timestamp = t,
+            .level_cm = day_level_cm(t) + 0.1f * rand() / RAND_MAX - 0.05f,
+            .confidence = 100,
+        };
+        readings++;
+        if (level_tracker_update(&tracker, &reading)) {
+            publishes++;
+        }
+    }
+
+    printf("day_replay: %u readings, %u publishes vs %u at a fixed %d min interval\n", readings, publishes,
+           day_s / (CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN * 60), CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN);
+    size_t count = level_tracker_peek_events(&tracker, events, LEVEL_TRACKER_MAX_EVENTS);
+    for (size_t i = 0; i < count; i++) {
+        printf("  %-11s %02u:%02u-%02u:%02u %.1f -> %.1f cm\n", level_event_name(events[i].type),
+               events[i].start / 3600, events[i].start / 60 % 60, events[i].end / 3600, events[i].end / 60 % 60,
+               events[i].start_cm, events[i].end_cm);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    const char *led_topics[] = {CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, CONFIG_SUBSCRIBE_LED_COLOR_TOPIC,
+                                CONFIG_SUBSCRIBE_LED_COLOR_TOPIC};
+    const char *led_payloads[] = {"{\"LED\": \"green\"}", "{\"LED\": \"RED\"}", "{\"LED\": \"yellow\"}"};
+    const char *manifest_topics[] = {DEVICE_MANIFEST_TOPIC};
+    const char *manifest_payloads[] = {
+        "{\"url\": \"https://bucket.s3.us-east-1.amazonaws.com/home/water-bowl/host-sim/firmware.bin\", "
+        "\"size\": 1212416, \"sha256\": \"9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08\", "
+        "\"version\": \"host-sim\"}"};
+    const char *mixed_topics[] = {CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, CONFIG_SUBSCRIBE_LED_COLOR_TOPIC,
+                                  CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, DEVICE_MANIFEST_TOPIC};
+    const char *mixed_payloads[] = {led_payloads[0], led_payloads[1], led_payloads[2], manifest_payloads[0]};
+
+    sim_init(SIM_TIME_SCALE);
+    sim_log_set_level(0);
+    sim_start_app();
+    if (!sim_wait_for_task("ultrasonic_read_task", 5000) || !sim_broker_connect()) {
+        fprintf(stderr, "Firmware did not come up in the simulator\n");
+        return 1;
+    }
+
+    printf("%-28s %8s %9s %9s %9s %11s %12s\n", "scenario", "count", "p50_ns", "p99_ns", "max_ns", "allocs/op",
+           "ops/s");
+    bench_deliveries("led_command", led_topics, led_payloads, 3, iterations);
+    bench_deliveries("ota_manifest_current", manifest_topics, manifest_payloads, 1, iterations);
+    bench_deliveries("burst_led_ota_mix", mixed_topics, mixed_payloads, 4, iterations);
+    bench_fleet_map(2, iterations);
+    bench_fleet_map(50, iterations);
+    bench_fleet_map(500, iterations / 10 + 1);
+    bench_ranging(iterations);
+    replay_outage(4);
+    replay_day();
+    replay_recovery();
+    replay_config();
+
+    replay_wifi_reconnect();
+
+    char report[METRICS_REPORT_MAX];
+    int report_len = metrics_format_report(report, sizeof(report));
+    printf("metrics (%d bytes): %s\n", report_len, report);
+
+    if (sim_reboot_count() > 0) {
+        printf("FAIL: firmware requested %u reboots\n", sim_reboot_count());
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
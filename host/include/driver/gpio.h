@@ -0,0 +1,4 @@
+#pragma once
+
+// main.c includes this for board setup; the simulator exposes no GPIO
+#include "esp_err.h"
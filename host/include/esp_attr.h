@@ -0,0 +1,6 @@
+#pragma once
+
+// Ordinary memory on the host; "RTC" state simply lives as long as the process
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_event.h"
+
+extern esp_event_base_t const IP_EVENT;
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include <stdint.h>
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// Recorded by the simulator instead of resetting the process
+void esp_restart(void);
+
+// Software resets since start are reported as ESP_RST_SW, otherwise power-on
+esp_reset_reason_t esp_reset_reason(void);
+
+// A fixed figure the size of an ESP32-C3 heap after Wi-Fi starts; the host heap is not bounded
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
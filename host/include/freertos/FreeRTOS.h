@@ -0,0 +1,40 @@
+/*
+ * Minimal FreeRTOS surface for the host simulation. Tasks are pthreads, ticks follow the
+ * simulator's scaled clock, and critical sections share one recursive mutex.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+// 32-bit like ESP-IDF's, so a product that wraps on the device wraps here too
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void sim_enter_critical(void);
+void sim_exit_critical(void);
+
+#define taskENTER_CRITICAL(mux) ((void)(mux), sim_enter_critical())
+#define taskEXIT_CRITICAL(mux) ((void)(mux), sim_exit_critical())
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "mqtt_client.h"
+
+// Recorded by the simulator instead of rebooting
+void error_reload(esp_mqtt_client_handle_t client);
+void get_device_mac_address(char *mac_address);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "mqtt_client.h"
+
+typedef struct {
+    const uint8_t *root_ca;
+    const uint8_t *certificate;
+    const uint8_t *private_key;
+    const char *broker_uri;
+} mqtt_config_t;
+
+typedef void (*mqtt_event_handler_t)(esp_mqtt_event_handle_t event);
+
+esp_mqtt_client_handle_t init_mqtt(mqtt_config_t *config);
+void mqtt_set_event_connected_handler(mqtt_event_handler_t handler);
+void mqtt_set_event_disconnected_handler(mqtt_event_handler_t handler);
+void mqtt_set_event_data_handler(mqtt_event_handler_t handler);
+void mqtt_set_event_error_handler(mqtt_event_handler_t handler);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    LED_STATE_OFF,
+    LED_STATE_SOLID,
+    LED_STATE_BLINK,
+} led_state_t;
+
+void init_rgb_led(void);
+void set_rgb_led_named_color(const char *name);
+void set_rgb_led_enumerated_values(uint8_t red, uint8_t green, uint8_t blue, led_state_t state, int period_ms);
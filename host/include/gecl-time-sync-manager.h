@@ -0,0 +1,3 @@
+#pragma once
+
+void init_time_sync(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Served by the scripted HC-SR04 simulator in host/sim/sim_gecl.c
+void hcsr04_init(void);
+bool hcsr04_is_initialized(void);
+float hcsr04_get_range(void);
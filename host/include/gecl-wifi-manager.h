@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdbool.h>
+
+void init_wifi(void);
+bool wifi_active(void);
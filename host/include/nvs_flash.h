@@ -0,0 +1,6 @@
+#pragma once
+
+#include "esp_err.h"
+
+// The first call writes the simulated bowl's identity, as scripts/provision/provision_bowl.sh would
+esp_err_t nvs_flash_init_partition(const char *partition_label);
@@ -0,0 +1,66 @@
+/*
+ * Host simulation configuration. Mirrors the Kconfig defaults in main/Kconfig.projbuild; the
+ * location-specific values normally come from the encrypted Kconfig and sdkconfig.<location>.
+ */
+#pragma once
+
+#define CONFIG_WIFI_HOSTNAME "waterbowl-sim"
+#define CONFIG_LOCATION "sim-room"
+#define CONFIG_IOT_ENDPOINT "mqtts://localhost:8883"
+#define CONFIG_SUBSCRIBE_LED_COLOR_TOPIC "local/waterbowl/sim/led"
+#define CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC "local/waterbowl/update"
+#define CONFIG_PUBLISH_WATER_LEVEL_TOPIC "local/waterbowl/level"
+#define CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN 5
+
+// Water Level Ranging
+#define CONFIG_RANGING_BACKEND_POLLED 1
+#define CONFIG_RANGING_BURST_SAMPLES 7
+#define CONFIG_RANGING_BURST_GAP_MS 60
+#define CONFIG_RANGING_MIN_DISTANCE_CM 2
+#define CONFIG_RANGING_MAX_DISTANCE_CM 400
+#define CONFIG_RANGING_MIN_VALID_SAMPLES 3
+#define CONFIG_RANGING_OUTLIER_FLOOR_MM 10
+#define CONFIG_RANGING_FILTER_MEDIAN 1
+
+// Water Level Reading Buffer
+#define CONFIG_READING_BUFFER_CAPACITY 48
+#define CONFIG_READING_BUFFER_NVS_SPILL 1
+
+// Water Level Telemetry
+#define CONFIG_TELEMETRY_FORMAT_JSON 1
+
+// MQTT Reconnect
+#define CONFIG_MQTT_RECONNECT_BASE_MS 1000
+#define CONFIG_MQTT_RECONNECT_MAX_MS 120000
+#define CONFIG_MQTT_RECONNECT_GIVE_UP_MIN 60
+
+// Recovery Supervisor
+#define CONFIG_SUPERVISOR_STEP_TIMEOUT_S 60
+
+// OTA Update
+#define CONFIG_OTA_GROUP ""
+#define CONFIG_PUBLISH_OTA_PROGRESS_TOPIC "local/waterbowl/ota/progress"
+#define CONFIG_OTA_STREAM_MAX_RETRIES 10
+
+// Fast Reconnect
+#define CONFIG_WIFI_FAST_RECONNECT 1
+#define CONFIG_LWIP_DHCP_RESTORE_LAST_IP 1
+
+// Power
+// CONFIG_DUTY_CYCLE_DEEP_SLEEP is not set
+
+// Runtime Configuration
+#define CONFIG_SUBSCRIBE_CONFIG_TOPIC "local/waterbowl/config"
+#define CONFIG_ORPHAN_TIMEOUT_MIN 120
+
+// Adaptive Sampling
+#define CONFIG_SAMPLING_MIN_INTERVAL_S 20
+#define CONFIG_SAMPLING_CHANGE_MM 3
+#define CONFIG_PUBLISH_DEADBAND_MM 5
+#define CONFIG_PUBLISH_HEARTBEAT_MIN 60
+#define CONFIG_LEVEL_EVENT_MIN_MM 8
+#define CONFIG_PUBLISH_LEVEL_EVENT_TOPIC "local/waterbowl/events"
+
+// Runtime Metrics
+#define CONFIG_METRICS_REPORT_INTERVAL_S 900
+#define CONFIG_PUBLISH_METRICS_TOPIC "local/waterbowl/metrics"
@@ -0,0 +1,64 @@
+/*
+ * Harness-facing API of the host simulation. The firmware in main/ is compiled unchanged against
+ * the stand-in headers in host/include; these calls let a harness drive it from the outside.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Simulated time runs time_scale times faster than wall time (esp_timer, ticks, delays)
+void sim_init(double time_scale);
+int64_t sim_real_ns(void);
+
+// 'E', 'W', 'I' or 'D' to print that level and above, 0 to silence the firmware
+void sim_log_set_level(char level);
+
+// Run app_main on its own task, as the ESP-IDF startup code would
+void sim_start_app(void);
+bool sim_wait_for_task(const char *name, int timeout_ms);
+
+// Invoke a FreeRTOS software timer's callback now, on the caller's thread
+bool sim_timer_fire(const char *name);
+
+// In-process broker. Deliveries and connection events run on the caller's thread, which plays the MQTT event task.
+bool sim_broker_connect(void);
+void sim_broker_disconnect(void);
+bool sim_broker_deliver(const char *topic, const char *payload, int len);
+bool sim_broker_is_subscribed(const char *topic);
+uint32_t sim_broker_published_count(const char *topic); // NULL counts every topic
+uint32_t sim_broker_published_bytes(const char *topic);
+// Acknowledge every QoS 1 publish so far, raising MQTT_EVENT_PUBLISHED for each
+void sim_broker_ack_pending(void);
+// Called with every publish the broker accepts, on the publishing thread; NULL to stop
+typedef void (*sim_broker_tap_t)(const char *topic, const char *payload, int len);
+void sim_broker_set_tap(sim_broker_tap_t tap);
+
+#define SIM_WIFI_SCAN_MS 2500  // Probing every channel before associating
+#define SIM_WIFI_DIRECT_MS 300 // One association attempt on a pinned BSSID and channel
+
+// Drop the station and let it re-associate: a full scan unless the firmware pinned the simulated AP, and a failed
+// attempt followed by another disconnect if the pin is stale. Runs the Wi-Fi and IP event handlers on the caller's
+// thread and returns the simulated milliseconds the attempts account for, independent of the time scale.
+uint32_t sim_wifi_reconnect(void);
+
+// Move the simulated AP to another BSSID and channel, so a pinned association fails
+void sim_wifi_move_ap(void);
+
+// Scripted HC-SR04: a surface at level_cm with uniform ripple, plus occasional splashes and missed echoes
+typedef struct {
+    float level_cm;
+    float ripple_cm;
+    float spike_probability;
+    float timeout_probability;
+} sim_hcsr04_script_t;
+
+void sim_hcsr04_set_script(const sim_hcsr04_script_t *script);
+float sim_hcsr04_sample(void);
+
+// Heap calls made by the calling thread (malloc, calloc, realloc), counted via linker wrapping
+uint64_t sim_alloc_count(void);
+
+// Number of error_reload/esp_restart calls, which the simulator records instead of rebooting
+uint32_t sim_reboot_count(void);
@@ -0,0 +1,291 @@
+#include "sim.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "gecl-mqtt-manager.h"
+#include "mqtt_client.h"
+
+#define SIM_BROKER_MAX_SUBSCRIPTIONS 16
+#define SIM_BROKER_MAX_TOPICS 16
+#define SIM_BROKER_TOPIC_MAX 128
+#define SIM_BROKER_MAX_UNACKED 64
+
+static const char *TAG = "SIM_BROKER";
+
+struct esp_mqtt_client {
+    mqtt_config_t config;
+    bool started;
+    bool connected;
+};
+
+typedef struct {
+    char topic[SIM_BROKER_TOPIC_MAX];
+    uint32_t messages;
+    uint32_t bytes;
+} topic_stats_t;
+
+static struct esp_mqtt_client client;
+static pthread_mutex_t broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static char subscriptions[SIM_BROKER_MAX_SUBSCRIPTIONS][SIM_BROKER_TOPIC_MAX];
+static size_t subscription_count = 0;
+static topic_stats_t published[SIM_BROKER_MAX_TOPICS];
+static size_t published_topics = 0;
+static int next_msg_id = 1;
+static int unacked[SIM_BROKER_MAX_UNACKED];
+static size_t unacked_count = 0;
+static size_t unacked_bytes = 0;
+static esp_event_handler_t published_handler = NULL;
+static void *published_handler_arg = NULL;
+static sim_broker_tap_t publish_tap = NULL;
+
+static mqtt_event_handler_t connected_handler = NULL;
+static mqtt_event_handler_t disconnected_handler = NULL;
+static mqtt_event_handler_t data_handler = NULL;
+static mqtt_event_handler_t error_handler = NULL;
+
+void mqtt_set_event_connected_handler(mqtt_event_handler_t handler) {
+    connected_handler = handler;
+}
+
+void mqtt_set_event_disconnected_handler(mqtt_event_handler_t handler) {
+    disconnected_handler = handler;
+}
+
+void mqtt_set_event_data_handler(mqtt_event_handler_t handler) {
+    data_handler = handler;
+}
+
+void mqtt_set_event_error_handler(mqtt_event_handler_t handler) {
+    error_handler = handler;
+}
+
+// The real manager starts the client and connects asynchronously; here the harness decides when
+esp_mqtt_client_handle_t init_mqtt(mqtt_config_t *config) {
+    client.config = *config;
+    client.started = true;
+    return &client;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t handle, const char *topic, const char *data, int len, int qos,
+                            int retain) {
+    topic_stats_t *stats = NULL;
+    int msg_id;
+    (void)retain;
+
+    if (len == 0 && data != NULL) {
+        len = strlen(data);
+    }
+
+    pthread_mutex_lock(&broker_lock);
+    if (handle == NULL || !handle->connected) {
+        pthread_mutex_unlock(&broker_lock);
+        return -1;
+    }
+    for (size_t i = 0; i < published_topics; i++) {
+        if (strcmp(published[i].topic, topic) == 0) {
+            stats = &published[i];
+        }
+    }
+    if (stats == NULL && published_topics < SIM_BROKER_MAX_TOPICS) {
+        stats = &published[published_topics++];
+        strncpy(stats->topic, topic, sizeof(stats->topic) - 1);
+    }
+    if (stats != NULL) {
+        stats->messages++;
+        stats->bytes += len;
+    }
+    msg_id = next_msg_id++;
+    if (qos > 0 && unacked_count < SIM_BROKER_MAX_UNACKED) {
+        unacked[unacked_count++] = msg_id;
+        unacked_bytes += len;
+    }
+    pthread_mutex_unlock(&broker_lock);
+
+    if (publish_tap != NULL) {
+        publish_tap(topic, data, len);
+    }
+    return msg_id;
+}
+
+void sim_broker_set_tap(sim_broker_tap_t tap) {
+    publish_tap = tap;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t handle, const char *topic, int qos) {
+    int msg_id;
+    (void)qos;
+
+    pthread_mutex_lock(&broker_lock);
+    if (handle == NULL || !handle->connected) {
+        pthread_mutex_unlock(&broker_lock);
+        return -1;
+    }
+    bool known = false;
+    for (size_t i = 0; i < subscription_count; i++) {
+        known |= strcmp(subscriptions[i], topic) == 0;
+    }
+    if (!known && subscription_count < SIM_BROKER_MAX_SUBSCRIPTIONS) {
+        strncpy(subscriptions[subscription_count++], topic, SIM_BROKER_TOPIC_MAX - 1);
+    }
+    msg_id = next_msg_id++;
+    pthread_mutex_unlock(&broker_lock);
+    return msg_id;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t handle, const char *topic) {
+    (void)handle;
+
+    pthread_mutex_lock(&broker_lock);
+    for (size_t i = 0; i < subscription_count; i++) {
+        if (strcmp(subscriptions[i], topic) == 0) {
+            memmove(subscriptions[i], subscriptions[i + 1], (subscription_count - i - 1) * SIM_BROKER_TOPIC_MAX);
+            subscription_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&broker_lock);
+    return next_msg_id++;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t handle) {
+    ESP_LOGI(TAG, "Reconnect requested");
+    return handle != NULL && handle->started ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+// Drops the session the way a broker-side close would; the firmware's disconnected handler runs on the caller
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t handle) {
+    if (handle == NULL || !handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_broker_disconnect();
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t handle) {
+    if (handle == NULL || !handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&broker_lock);
+    handle->started = false;
+    handle->connected = false;
+    pthread_mutex_unlock(&broker_lock);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t handle) {
+    size_t bytes;
+
+    pthread_mutex_lock(&broker_lock);
+    bytes = unacked_bytes;
+    pthread_mutex_unlock(&broker_lock);
+    return bytes;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t handle, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg) {
+    if (event != MQTT_EVENT_PUBLISHED) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    published_handler = event_handler;
+    published_handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+void sim_broker_ack_pending(void) {
+    int acks[SIM_BROKER_MAX_UNACKED];
+    size_t count;
+
+    pthread_mutex_lock(&broker_lock);
+    count = unacked_count;
+    memcpy(acks, unacked, count * sizeof(int));
+    unacked_count = 0;
+    unacked_bytes = 0;
+    pthread_mutex_unlock(&broker_lock);
+
+    for (size_t i = 0; i < count && published_handler != NULL; i++) {
+        esp_mqtt_event_t event = {.event_id = MQTT_EVENT_PUBLISHED, .client = &client, .msg_id = acks[i]};
+        published_handler(published_handler_arg, "MQTT_EVENTS", MQTT_EVENT_PUBLISHED, &event);
+    }
+}
+
+bool sim_broker_connect(void) {
+    esp_mqtt_event_t event = {.event_id = MQTT_EVENT_CONNECTED, .client = &client};
+
+    if (!client.started) {
+        return false;
+    }
+    pthread_mutex_lock(&broker_lock);
+    client.connected = true;
+    // A clean session forgets subscriptions; the connected handler must restore them
+    subscription_count = 0;
+    pthread_mutex_unlock(&broker_lock);
+
+    if (connected_handler != NULL) {
+        connected_handler(&event);
+    }
+    return true;
+}
+
+void sim_broker_disconnect(void) {
+    esp_mqtt_event_t event = {.event_id = MQTT_EVENT_DISCONNECTED, .client = &client};
+
+    pthread_mutex_lock(&broker_lock);
+    client.connected = false;
+    pthread_mutex_unlock(&broker_lock);
+
+    if (disconnected_handler != NULL) {
+        disconnected_handler(&event);
+    }
+}
+
+bool sim_broker_is_subscribed(const char *topic) {
+    bool found = false;
+
+    pthread_mutex_lock(&broker_lock);
+    for (size_t i = 0; i < subscription_count; i++) {
+        found |= strcmp(subscriptions[i], topic) == 0;
+    }
+    pthread_mutex_unlock(&broker_lock);
+    return found;
+}
+
+bool sim_broker_deliver(const char *topic, const char *payload, int len) {
+    esp_mqtt_event_t event = {
+        .event_id = MQTT_EVENT_DATA,
+        .client = &client,
+        .data = (char *)payload,
+        .data_len = len,
+        .total_data_len = len,
+        .topic = (char *)topic,
+        .topic_len = strlen(topic),
+    };
+
+    if (!client.connected || !sim_broker_is_subscribed(topic) || data_handler == NULL) {
+        return false;
+    }
+    data_handler(&event);
+    return true;
+}
+
+static uint32_t sum_stats(const char *topic, bool bytes) {
+    uint32_t total = 0;
+
+    pthread_mutex_lock(&broker_lock);
+    for (size_t i = 0; i < published_topics; i++) {
+        if (topic == NULL || strcmp(published[i].topic, topic) == 0) {
+            total += bytes ? published[i].bytes : published[i].messages;
+        }
+    }
+    pthread_mutex_unlock(&broker_lock);
+    return total;
+}
+
+uint32_t sim_broker_published_count(const char *topic) {
+    return sum_stats(topic, false);
+}
+
+uint32_t sim_broker_published_bytes(const char *topic) {
+    return sum_stats(topic, true);
+}
@@ -0,0 +1,225 @@
+#include "sim.h"
+#include "sim_internal.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SIM_HEAP_SIZE (200 * 1024)
+
+extern void app_main(void);
+
+static double time_scale = 1.0;
+static int64_t start_ns = 0;
+static char log_level = 'W';
+static pthread_mutex_t critical_lock;
+static uint32_t random_state = 0x2545f491;
+static uint32_t reboots = 0;
+
+static __thread uint64_t thread_allocs = 0;
+
+int64_t sim_real_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void sim_init(double scale) {
+    pthread_mutexattr_t attr;
+
+    time_scale = scale > 0 ? scale : 1.0;
+    start_ns = sim_real_ns();
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+double sim_time_scale(void) {
+    return time_scale;
+}
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)((sim_real_ns() - start_ns) * time_scale / 1000);
+}
+
+void sim_log_set_level(char level) {
+    log_level = level;
+}
+
+static int level_rank(char level) {
+    switch (level) {
+    case 'E':
+        return 1;
+    case 'W':
+        return 2;
+    case 'I':
+        return 3;
+    case 'D':
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+void sim_log(char level, const char *tag, const char *format, ...) {
+    va_list args;
+
+    if (level_rank(level) == 0 || level_rank(level) > level_rank(log_level)) {
+        return;
+    }
+    fprintf(stderr, "%c (%lld) %s: ", level, (long long)(esp_timer_get_time() / 1000), tag);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void sim_enter_critical(void) {
+    pthread_mutex_lock(&critical_lock);
+}
+
+void sim_exit_critical(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+void sim_abort(const char *file, int line, const char *expr, esp_err_t err) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s (0x%x) at %s:%d\n", expr, err, file, line);
+    abort();
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+// xorshift32; deterministic so runs are comparable commit to commit
+uint32_t esp_random(void) {
+    sim_enter_critical();
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+    sim_exit_critical();
+    return x;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    (void)us;
+}
+
+void sim_record_reboot(void) {
+    sim_enter_critical();
+    reboots++;
+    sim_exit_critical();
+}
+
+uint32_t sim_reboot_count(void) {
+    return reboots;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return reboots > 0 ? ESP_RST_SW : ESP_RST_POWERON;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return SIM_HEAP_SIZE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return SIM_HEAP_SIZE;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+    return ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    sim_log('I', "SIM", "Deep sleep wakeup in %llu us", (unsigned long long)time_in_us);
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void) {
+    sim_log('W', "SIM", "esp_deep_sleep_start() called, ending task");
+    pthread_exit(NULL);
+}
+
+void esp_restart(void) {
+    sim_log('E', "SIM", "esp_restart() called");
+    sim_record_reboot();
+}
+
+static void app_main_task(void *arg) {
+    (void)arg;
+    app_main();
+    vTaskDelete(NULL);
+}
+
+void sim_start_app(void) {
+    xTaskCreate(app_main_task, "main", 3584, NULL, 1, NULL);
+}
+
+// Linked with -Wl,--wrap so every heap call from the firmware and the simulator is counted per thread
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    thread_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    thread_allocs++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    thread_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+uint64_t sim_alloc_count(void) {
+    return thread_allocs;
+}
@@ -0,0 +1,487 @@
+#include "sim.h"
+#include "sim_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#define SIM_MAX_TASKS 16
+#define SIM_MAX_TIMERS 16
+
+struct sim_task {
+    pthread_t thread;
+    char name[32];
+    TaskFunction_t code;
+    void *parameters;
+    uint32_t stack_depth;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+    eTaskState state;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t storage[];
+};
+
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+struct sim_timer {
+    char name[32];
+    TickType_t period;
+    BaseType_t auto_reload;
+    void *timer_id;
+    TimerCallbackFunction_t callback;
+    bool active;
+};
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool active;
+};
+
+static struct sim_task tasks[SIM_MAX_TASKS];
+static size_t task_count = 0;
+static struct sim_timer *timers[SIM_MAX_TIMERS];
+static size_t timer_count = 0;
+static struct esp_timer *esp_timers[SIM_MAX_TIMERS];
+static size_t esp_timer_count = 0;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct sim_task *current_task = NULL;
+
+// Convert simulated ticks into an absolute CLOCK_MONOTONIC deadline
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts;
+    int64_t ns = (int64_t)((double)ticks * portTICK_PERIOD_MS * 1000000 / sim_time_scale());
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns += ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Wait on cond until woken or the tick timeout passes. Returns false on timeout.
+static bool timed_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static void *task_entry(void *arg) {
+    struct sim_task *task = arg;
+
+    current_task = task;
+    task->code(task->parameters);
+    // FreeRTOS tasks must not return; treat it like vTaskDelete(NULL)
+    task->state = eDeleted;
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *created_task) {
+    struct sim_task *task;
+    (void)priority;
+
+    pthread_mutex_lock(&registry_lock);
+    if (task_count == SIM_MAX_TASKS) {
+        pthread_mutex_unlock(&registry_lock);
+        return pdFAIL;
+    }
+    task = &tasks[task_count++];
+    pthread_mutex_unlock(&registry_lock);
+
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->code = task_code;
+    task->parameters = parameters;
+    task->stack_depth = stack_depth;
+    task->state = eReady;
+    pthread_mutex_init(&task->lock, NULL);
+    init_cond(&task->cond);
+
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        task->state = eDeleted;
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        if (current_task != NULL) {
+            current_task->state = eDeleted;
+        }
+        pthread_exit(NULL);
+    }
+    // Another thread cannot be stopped safely; it is only marked deleted
+    task->state = eDeleted;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+    return task != NULL ? task->state : eInvalid;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (task == NULL) {
+        task = current_task;
+    }
+    return task != NULL ? task->stack_depth : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct sim_task *task = current_task;
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    uint32_t value;
+
+    if (task == NULL) {
+        vTaskDelay(ticks_to_wait);
+        return 0;
+    }
+
+    pthread_mutex_lock(&task->lock);
+    task->state = eBlocked;
+    while (task->notify_value == 0 && ticks_to_wait > 0) {
+        if (!timed_wait(&task->cond, &task->lock, ticks_to_wait, &deadline)) {
+            break;
+        }
+    }
+    task->state = eRunning;
+    value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_value++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+bool sim_wait_for_task(const char *name, int timeout_ms) {
+    int64_t deadline = sim_real_ns() + (int64_t)timeout_ms * 1000000;
+
+    do {
+        pthread_mutex_lock(&registry_lock);
+        for (size_t i = 0; i < task_count; i++) {
+            if (strcmp(tasks[i].name, name) == 0) {
+                pthread_mutex_unlock(&registry_lock);
+                return true;
+            }
+        }
+        pthread_mutex_unlock(&registry_lock);
+        struct timespec pause = {.tv_nsec = 1000000};
+        nanosleep(&pause, NULL);
+    } while (sim_real_ns() < deadline);
+    return false;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue *queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->changed);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    struct timespec deadline = deadline_after(ticks_to_wait);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (ticks_to_wait == 0 || !timed_wait(&queue->changed, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    memcpy(&queue->storage[((queue->head + queue->count) % queue->length) * queue->item_size], item,
+           queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait) {
+    struct timespec deadline = deadline_after(ticks_to_wait);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks_to_wait == 0 || !timed_wait(&queue->changed, &queue->lock, ticks_to_wait, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    memcpy(buffer, &queue->storage[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, BaseType_t auto_reload, void *timer_id,
+                           TimerCallbackFunction_t callback) {
+    struct sim_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL) {
+        return NULL;
+    }
+    strncpy(timer->name, name, sizeof(timer->name) - 1);
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->timer_id = timer_id;
+    timer->callback = callback;
+
+    pthread_mutex_lock(&registry_lock);
+    if (timer_count < SIM_MAX_TIMERS) {
+        timers[timer_count++] = timer;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    timer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    timer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    timer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t new_period, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    timer->period = new_period;
+    timer->active = true;
+    return pdPASS;
+}
+
+TickType_t xTimerGetPeriod(TimerHandle_t timer) {
+    return timer->period;
+}
+
+// Fires the named FreeRTOS software timer or esp_timer
+bool sim_timer_fire(const char *name) {
+    struct sim_timer *timer = NULL;
+    struct esp_timer *hires = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (size_t i = 0; i < timer_count; i++) {
+        if (strcmp(timers[i]->name, name) == 0) {
+            timer = timers[i];
+        }
+    }
+    for (size_t i = 0; i < esp_timer_count; i++) {
+        if (esp_timers[i]->args.name != NULL && strcmp(esp_timers[i]->args.name, name) == 0) {
+            hires = esp_timers[i];
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (timer != NULL) {
+        timer->active = timer->auto_reload;
+        timer->callback(timer);
+        return true;
+    }
+    if (hires != NULL) {
+        hires->active = false;
+        hires->args.callback(hires->args.arg);
+        return true;
+    }
+    return false;
+}
+
+// esp_timer instances are tracked but, like software timers, never expire on their own
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->args = *create_args;
+    *out_handle = timer;
+
+    pthread_mutex_lock(&registry_lock);
+    if (esp_timer_count < SIM_MAX_TIMERS) {
+        esp_timers[esp_timer_count++] = timer;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    (void)timeout_us;
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return esp_timer_start_once(timer, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct sim_event_group *group = calloc(1, sizeof(*group));
+
+    if (group == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    init_cond(&group->changed);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t value;
+
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    value = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t value;
+
+    pthread_mutex_lock(&group->lock);
+    value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    EventBits_t value;
+
+    pthread_mutex_lock(&group->lock);
+    value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    struct timespec deadline = deadline_after(ticks_to_wait);
+    EventBits_t value;
+
+    pthread_mutex_lock(&group->lock);
+    while (true) {
+        EventBits_t set = group->bits & bits;
+        if (wait_for_all ? set == bits : set != 0) {
+            break;
+        }
+        if (ticks_to_wait == 0 || !timed_wait(&group->changed, &group->lock, ticks_to_wait, &deadline)) {
+            break;
+        }
+    }
+    value = group->bits;
+    if (clear_on_exit && (wait_for_all ? (value & bits) == bits : (value & bits) != 0)) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
@@ -0,0 +1,7 @@
+// Shared between the simulator's translation units only
+#pragma once
+
+#include <stdint.h>
+
+double sim_time_scale(void);
+void sim_record_reboot(void);
@@ -0,0 +1,143 @@
+#include "sim.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gecl-wifi-manager.h"
+
+#define SIM_EVENT_MAX_HANDLERS 16
+#define SIM_WIFI_MAX_ATTEMPTS 4 // Associations tried per reconnect before the simulated station gives up
+
+static const char *TAG = "SIM_WIFI";
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} sim_event_handler_t;
+
+static uint8_t ap_bssid[6] = {0x02, 0x00, 0x5e, 0x10, 0x20, 0x30};
+static uint8_t ap_channel = 6;
+
+static sim_event_handler_t handlers[SIM_EVENT_MAX_HANDLERS];
+static size_t handler_count = 0;
+static pthread_mutex_t wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+static wifi_config_t sta_config = {.sta = {.ssid = "sim-ap"}};
+static bool associated = true;
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler,
+                                     void *event_handler_arg) {
+    pthread_mutex_lock(&wifi_lock);
+    if (handler_count == SIM_EVENT_MAX_HANDLERS) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[handler_count++] = (sim_event_handler_t){event_base, event_id, event_handler, event_handler_arg};
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+static void post_event(esp_event_base_t base, int32_t id) {
+    for (size_t i = 0; i < handler_count; i++) {
+        if (handlers[i].base == base && (handlers[i].id == id || handlers[i].id == ESP_EVENT_ANY_ID)) {
+            handlers[i].handler(handlers[i].arg, base, id, NULL);
+        }
+    }
+}
+
+bool wifi_active(void) {
+    return associated;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf) {
+    pthread_mutex_lock(&wifi_lock);
+    *conf = sta_config;
+    pthread_mutex_unlock(&wifi_lock);
+    return interface == WIFI_IF_STA ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wifi_lock);
+    sta_config = *conf;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    if (!associated) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, ap_bssid, sizeof(ap_bssid));
+    memcpy(ap_info->ssid, sta_config.sta.ssid, sizeof(sta_config.sta.ssid));
+    ap_info->primary = ap_channel;
+    ap_info->rssi = -55;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    if (!associated) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+    associated = false;
+    post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED);
+    return ESP_OK;
+}
+
+// Associates at once; sim_wifi_reconnect is the one that models how long it takes
+esp_err_t esp_wifi_connect(void) {
+    associated = true;
+    post_event(IP_EVENT, IP_EVENT_STA_GOT_IP);
+    return ESP_OK;
+}
+
+void sim_wifi_move_ap(void) {
+    ap_bssid[5]++;
+    ap_channel = ap_channel == 6 ? 11 : 6;
+}
+
+uint32_t sim_wifi_reconnect(void) {
+    wifi_config_t config;
+    uint32_t taken_ms = 0;
+
+    associated = false;
+    post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED);
+
+    for (int attempt = 0; attempt < SIM_WIFI_MAX_ATTEMPTS && !associated; attempt++) {
+        esp_wifi_get_config(WIFI_IF_STA, &config);
+        if (!config.sta.bssid_set) {
+            // A full scan finds the AP wherever it is now
+            taken_ms += SIM_WIFI_SCAN_MS;
+            associated = true;
+        } else if (config.sta.channel == ap_channel && memcmp(config.sta.bssid, ap_bssid, sizeof(ap_bssid)) == 0) {
+            taken_ms += SIM_WIFI_DIRECT_MS;
+            associated = true;
+        } else {
+            // Nobody answers on the pinned BSSID and channel; the driver reports another disconnect
+            taken_ms += SIM_WIFI_DIRECT_MS;
+            post_event(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED);
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(taken_ms));
+    if (!associated) {
+        ESP_LOGE(TAG, "No association after %d attempts", SIM_WIFI_MAX_ATTEMPTS);
+        return taken_ms;
+    }
+    ESP_LOGI(TAG, "Associated after %s", config.sta.bssid_set ? "direct connect" : "full scan");
+    post_event(IP_EVENT, IP_EVENT_STA_GOT_IP);
+    return taken_ms;
+}
@@ -0,0 +1,82 @@
+#include "duty_cycle.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include <stddef.h>
+#include <string.h>
+
+#include "reading_buffer.h"
+
+#define DUTY_CYCLE_MAGIC 0x57445332 // "WDS2"
+#define DUTY_CYCLE_MIN_SLEEP_US (1000 * 1000)
+
+static const char *TAG = "DUTY_CYCLE";
+
+typedef struct {
+    uint32_t magic;
+    uint32_t wakes;               // Since power-on
+    uint32_t wakes_since_connect; // Including this one
+    uint32_t crc;
+} duty_cycle_state_t;
+
+// Survives deep sleep and software resets; validated by magic and CRC like the reading buffer
+static RTC_NOINIT_ATTR duty_cycle_state_t state;
+
+static bool woke_from_sleep = false;
+
+static uint32_t state_crc(const duty_cycle_state_t *s) {
+    return esp_rom_crc32_le(0, (const uint8_t *)s, offsetof(duty_cycle_state_t, crc));
+}
+
+static void state_seal(void) {
+    state.crc = state_crc(&state);
+}
+
+void duty_cycle_init(void) {
+    woke_from_sleep = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+
+    if (state.magic != DUTY_CYCLE_MAGIC || state.crc != state_crc(&state)) {
+        memset(&state, 0, sizeof(state));
+        state.magic = DUTY_CYCLE_MAGIC;
+    }
+    state.wakes++;
+    state.wakes_since_connect++;
+    state_seal();
+
+    ESP_LOGI(TAG, "Wake %lu (%s), %lu since last connection", (unsigned long)state.wakes,
+             woke_from_sleep ? "timer" : "reset", (unsigned long)state.wakes_since_connect);
+}
+
+bool duty_cycle_connect_due(void) {
+#if CONFIG_DUTY_CYCLE_DEEP_SLEEP
+    // A cold boot always connects so the clock gets synced and pending commands get picked up
+    if (!woke_from_sleep || state.wakes_since_connect >= CONFIG_DUTY_CYCLE_CONNECT_EVERY) {
+        return true;
+    }
+    // Don't let the buffer start overwriting readings while we wait for the next scheduled connection
+    return reading_buffer_count() >= CONFIG_READING_BUFFER_CAPACITY - 1;
+#else
+    return true;
+#endif
+}
+
+void duty_cycle_note_connected(void) {
+    state.wakes_since_connect = 0;
+    state_seal();
+}
+
+void duty_cycle_sleep(uint32_t interval_ms) {
+    int64_t sleep_us = (int64_t)interval_ms * 1000 - esp_timer_get_time();
+
+    if (sleep_us < DUTY_CYCLE_MIN_SLEEP_US) {
+        sleep_us = DUTY_CYCLE_MIN_SLEEP_US;
+    }
+    ESP_LOGI(TAG, "Awake for %lld ms, sleeping %lld s", (long long)(esp_timer_get_time() / 1000),
+             (long long)(sleep_us / 1000000));
+
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
+}
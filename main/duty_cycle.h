@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Deep-sleep duty cycling. Pending readings and their sequence numbers already live in the RTC-retained
+ * reading buffer; this keeps the rest of the state a wake needs: how many wakes have passed since the last
+ * connection.
+ */
+
+// Validate the RTC-retained state and count this boot as a wake
+void duty_cycle_init(void);
+
+// Whether this wake should bring up Wi-Fi and MQTT, or just range and queue
+bool duty_cycle_connect_due(void);
+
+// Reset the wakes-since-connect count once MQTT is up
+void duty_cycle_note_connected(void);
+
+// Deep sleep until interval_ms after this wake began, regardless of how long the wake took
+void duty_cycle_sleep(uint32_t interval_ms);
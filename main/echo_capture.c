@@ -0,0 +1,114 @@
+#include "echo_capture.h"
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Round-trip time of sound per cm of range at ~20 C
+#define ECHO_US_PER_CM 58.3f
+// A 400 cm echo takes ~23 ms; anything past this is a missed echo
+#define ECHO_TIMEOUT_MS 30
+
+static const char *TAG = "ECHO_CAPTURE";
+
+static QueueHandle_t echo_queue = NULL;
+// 32-bit so the task's reset and the ISR's accesses are single, untearable words on the C3. The low word of
+// esp_timer wraps every ~71 minutes; unsigned subtraction still gives the right width across the wrap.
+static volatile uint32_t echo_rise_us = 0;
+static volatile bool echo_rising = false;
+
+// Timestamps both edges of the echo pulse; the width is handed to the waiting task
+static void IRAM_ATTR echo_isr_handler(void *arg) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    if (gpio_get_level(CONFIG_ECHO_CAPTURE_ECHO_GPIO)) {
+        echo_rise_us = now;
+        echo_rising = true;
+    } else if (echo_rising) {
+        uint32_t width_us = now - echo_rise_us;
+        BaseType_t higher_priority_woken = pdFALSE;
+
+        echo_rising = false;
+        xQueueSendFromISR(echo_queue, &width_us, &higher_priority_woken);
+        portYIELD_FROM_ISR(higher_priority_woken);
+    }
+}
+
+esp_err_t echo_capture_init(void) {
+    if (echo_queue != NULL) {
+        return ESP_OK;
+    }
+
+    echo_queue = xQueueCreate(1, sizeof(uint32_t));
+    if (echo_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    gpio_config_t trigger = {
+        .pin_bit_mask = 1ULL << CONFIG_ECHO_CAPTURE_TRIGGER_GPIO,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    gpio_config_t echo = {
+        .pin_bit_mask = 1ULL << CONFIG_ECHO_CAPTURE_ECHO_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+
+    esp_err_t err = gpio_config(&trigger);
+    if (err == ESP_OK) {
+        err = gpio_config(&echo);
+    }
+    if (err == ESP_OK) {
+        gpio_set_level(CONFIG_ECHO_CAPTURE_TRIGGER_GPIO, 0);
+        // Another component may already own the ISR service
+        err = gpio_install_isr_service(0);
+        if (err == ESP_ERR_INVALID_STATE) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add(CONFIG_ECHO_CAPTURE_ECHO_GPIO, echo_isr_handler, NULL);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up echo capture: %s", esp_err_to_name(err));
+        vQueueDelete(echo_queue);
+        echo_queue = NULL;
+    }
+    return err;
+}
+
+float echo_capture_ping(void) {
+    uint32_t width_us;
+
+    if (echo_queue == NULL && echo_capture_init() != ESP_OK) {
+        return -1.0f;
+    }
+
+    // Discard any half-captured pulse from a previous timed-out ping
+    echo_rising = false;
+    xQueueReset(echo_queue);
+
+    gpio_set_level(CONFIG_ECHO_CAPTURE_TRIGGER_GPIO, 1);
+    esp_rom_delay_us(10);
+    gpio_set_level(CONFIG_ECHO_CAPTURE_TRIGGER_GPIO, 0);
+
+    // The task blocks here, leaving the core free to idle while the echo is in flight
+    if (xQueueReceive(echo_queue, &width_us, pdMS_TO_TICKS(ECHO_TIMEOUT_MS) + 1) != pdTRUE) {
+        ESP_LOGD(TAG, "Echo timed out");
+        return -1.0f;
+    }
+
+    return width_us / ECHO_US_PER_CM;
+}
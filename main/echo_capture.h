@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Configure the trigger/echo pins and install the echo edge ISR
+esp_err_t echo_capture_init(void);
+
+// Fire one ping and block (without spinning) until its echo is captured.
+// Returns the distance in cm, or a negative value on timeout.
+float echo_capture_ping(void);
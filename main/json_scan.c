@@ -0,0 +1,216 @@
+#include "json_scan.h"
+
+#include <string.h>
+
+typedef struct {
+    const char *p;
+    const char *end;
+} json_cursor_t;
+
+static void skip_whitespace(json_cursor_t *c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+        c->p++;
+    }
+}
+
+// Leaves the cursor just past the closing quote
+static bool scan_string(json_cursor_t *c, json_span_t *span) {
+    const char *start = ++c->p;
+
+    while (c->p < c->end && *c->p != '"') {
+        c->p += (*c->p == '\\' && c->p + 1 < c->end) ? 2 : 1;
+    }
+    if (c->p >= c->end) {
+        return false;
+    }
+    span->start = start;
+    span->len = c->p - start;
+    span->type = JSON_TYPE_STRING;
+    c->p++;
+    return true;
+}
+
+// Skips a whole object or array by bracket depth, ignoring brackets inside strings
+static bool scan_container(json_cursor_t *c, json_span_t *span) {
+    const char *start = c->p;
+    size_t depth = 0;
+
+    while (c->p < c->end) {
+        char ch = *c->p;
+        if (ch == '"') {
+            json_span_t ignored;
+            if (!scan_string(c, &ignored)) {
+                return false;
+            }
+            continue;
+        }
+        if (ch == '{' || ch == '[') {
+            depth++;
+        } else if (ch == '}' || ch == ']') {
+            if (--depth == 0) {
+                c->p++;
+                span->start = start;
+                span->len = c->p - start;
+                span->type = *start == '{' ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY;
+                return true;
+            }
+        }
+        c->p++;
+    }
+    return false;
+}
+
+static bool scan_value(json_cursor_t *c, json_span_t *span) {
+    skip_whitespace(c);
+    if (c->p >= c->end) {
+        return false;
+    }
+
+    char ch = *c->p;
+    if (ch == '"') {
+        return scan_string(c, span);
+    }
+    if (ch == '{' || ch == '[') {
+        return scan_container(c, span);
+    }
+
+    const char *start = c->p;
+    while (c->p < c->end && *c->p != ',' && *c->p != '}' && *c->p != ']' && *c->p != ' ' && *c->p != '\t' &&
+           *c->p != '\n' && *c->p != '\r') {
+        c->p++;
+    }
+    if (c->p == start) {
+        return false;
+    }
+    span->start = start;
+    span->len = c->p - start;
+    span->type = (ch == '-' || (ch >= '0' && ch <= '9')) ? JSON_TYPE_NUMBER : JSON_TYPE_LITERAL;
+    return true;
+}
+
+bool json_scan_next(const char *json, size_t len, size_t *offset, json_span_t *key, json_span_t *value) {
+    json_cursor_t c = {.p = json + *offset, .end = json + len};
+
+    if (json == NULL || *offset > len) {
+        return false;
+    }
+
+    skip_whitespace(&c);
+    // Opening brace before the first member, a comma before every other one
+    if (c.p >= c.end || *c.p != (*offset == 0 ? '{' : ',')) {
+        return false; // End of object, or malformed
+    }
+    c.p++;
+
+    skip_whitespace(&c);
+    if (c.p >= c.end || *c.p != '"' || !scan_string(&c, key)) {
+        return false;
+    }
+    skip_whitespace(&c);
+    if (c.p >= c.end || *c.p != ':') {
+        return false;
+    }
+    c.p++;
+    if (!scan_value(&c, value)) {
+        return false;
+    }
+    *offset = c.p - json;
+    return true;
+}
+
+bool json_scan_at_end(const char *json, size_t len, size_t offset) {
+    json_cursor_t c = {.p = json + offset, .end = json + len};
+
+    if (json == NULL || offset > len) {
+        return false;
+    }
+    if (offset == 0) {
+        // Only an empty object ends before its first member
+        skip_whitespace(&c);
+        if (c.p >= c.end || *c.p != '{') {
+            return false;
+        }
+        c.p++;
+    }
+    skip_whitespace(&c);
+    return c.p < c.end && *c.p == '}';
+}
+
+bool json_scan_find(const char *json, size_t len, const char *key, json_span_t *value) {
+    size_t key_len = strlen(key);
+    size_t offset = 0;
+    json_span_t member_key;
+
+    while (json_scan_next(json, len, &offset, &member_key, value)) {
+        if (member_key.len == key_len && memcmp(member_key.start, key, key_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool json_span_to_string(const json_span_t *span, char *out, size_t out_size) {
+    size_t n = 0;
+
+    if (span->type != JSON_TYPE_STRING || out_size == 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < span->len; i++) {
+        char ch = span->start[i];
+
+        if (ch == '\\' && i + 1 < span->len) {
+            switch (span->start[++i]) {
+            case 'n':
+                ch = '\n';
+                break;
+            case 't':
+                ch = '\t';
+                break;
+            case 'r':
+                ch = '\r';
+                break;
+            case 'b':
+                ch = '\b';
+                break;
+            case 'f':
+                ch = '\f';
+                break;
+            case 'u':
+                // Nothing we read needs non-ASCII; keep the escape bounded rather than decode UTF-16
+                if (i + 4 >= span->len) {
+                    return false;
+                }
+                i += 4;
+                ch = '?';
+                break;
+            default: // \" \\ \/
+                ch = span->start[i];
+                break;
+            }
+        }
+        if (n + 1 >= out_size) {
+            return false;
+        }
+        out[n++] = ch;
+    }
+    out[n] = '\0';
+    return true;
+}
+
+bool json_span_to_uint32(const json_span_t *span, uint32_t *out) {
+    uint32_t value = 0;
+
+    if (span->type != JSON_TYPE_NUMBER || span->len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < span->len; i++) {
+        char ch = span->start[i];
+        if (ch < '0' || ch > '9' || value > (UINT32_MAX - (ch - '0')) / 10) {
+            return false;
+        }
+        value = value * 10 + (ch - '0');
+    }
+    *out = value;
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JSON_TYPE_INVALID,
+    JSON_TYPE_STRING,
+    JSON_TYPE_NUMBER,
+    JSON_TYPE_OBJECT,
+    JSON_TYPE_ARRAY,
+    JSON_TYPE_LITERAL, // true, false or null
+} json_type_t;
+
+// A value located inside the caller's buffer. Strings exclude their quotes and keep escapes intact.
+typedef struct {
+    const char *start;
+    size_t len;
+    json_type_t type;
+} json_span_t;
+
+/*
+ * Find a member of the top-level object in a length-bounded, not necessarily NUL-terminated
+ * buffer. Nothing is allocated and nesting is skipped iteratively, so the cost is one linear pass.
+ * Keys are compared byte-for-byte without unescaping.
+ */
+bool json_scan_find(const char *json, size_t len, const char *key, json_span_t *value);
+
+// Step through the members of the top-level object. Start with *offset = 0; returns false past the last member.
+bool json_scan_next(const char *json, size_t len, size_t *offset, json_span_t *key, json_span_t *value);
+
+// After json_scan_next returns false: true if it stopped at the closing brace rather than at malformed input
+bool json_scan_at_end(const char *json, size_t len, size_t offset);
+
+// Unescape a string span into out. Fails rather than truncating.
+bool json_span_to_string(const json_span_t *span, char *out, size_t out_size);
+
+// Parse a non-negative integer span. Fails on fractions, signs and overflow.
+bool json_span_to_uint32(const json_span_t *span, uint32_t *out);
@@ -0,0 +1,207 @@
+#include "level_tracker.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <math.h>
+#include <string.h>
+
+#define LEVEL_TRACKER_MAGIC 0x574c5431 // "WLT1"
+#define LEVEL_TRACKER_SETTLE_READINGS 2
+
+#define SAMPLING_MIN_MS ((uint32_t)CONFIG_SAMPLING_MIN_INTERVAL_S * 1000)
+#define SAMPLING_MAX_MS ((uint32_t)CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN * 60 * 1000)
+#define CHANGE_CM (CONFIG_SAMPLING_CHANGE_MM / 10.0f)
+#define DEADBAND_CM (CONFIG_PUBLISH_DEADBAND_MM / 10.0f)
+#define EVENT_MIN_CM (CONFIG_LEVEL_EVENT_MIN_MM / 10.0f)
+#define HEARTBEAT_S ((uint32_t)CONFIG_PUBLISH_HEARTBEAT_MIN * 60)
+
+static const char *TAG = "LEVEL_TRACKER";
+
+static level_tracker_tuning_t tuning = {
+    .min_interval_ms = SAMPLING_MIN_MS,
+    .max_interval_ms = SAMPLING_MAX_MS,
+    .deadband_cm = DEADBAND_CM,
+};
+
+static uint32_t tracker_crc(const level_tracker_t *t) {
+    return esp_rom_crc32_le(0, (const uint8_t *)t, offsetof(level_tracker_t, crc));
+}
+
+bool level_tracker_init(level_tracker_t *tracker) {
+    if (tracker->magic == LEVEL_TRACKER_MAGIC && tracker->event_count <= LEVEL_TRACKER_MAX_EVENTS &&
+        tracker->event_head < LEVEL_TRACKER_MAX_EVENTS && tracker->crc == tracker_crc(tracker)) {
+        return true;
+    }
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->magic = LEVEL_TRACKER_MAGIC;
+    tracker->interval_ms = tuning.min_interval_ms;
+    tracker->crc = tracker_crc(tracker);
+    return false;
+}
+
+static void queue_event(level_tracker_t *t, const level_event_t *event) {
+    if (t->event_count == LEVEL_TRACKER_MAX_EVENTS) {
+        ESP_LOGW(TAG, "Event queue full, dropping the oldest");
+        t->event_head = (t->event_head + 1) % LEVEL_TRACKER_MAX_EVENTS;
+        t->event_count--;
+    }
+    t->events[(t->event_head + t->event_count) % LEVEL_TRACKER_MAX_EVENTS] = *event;
+    t->event_count++;
+
+    ESP_LOGI(TAG, "%s: %.1f -> %.1f cm over %lu s", level_event_name(event->type), event->start_cm, event->end_cm,
+             (unsigned long)(event->end - event->start));
+}
+
+// Returns true when the reading closes an event, so the settled level gets published
+static bool track_event(level_tracker_t *t, float level, uint32_t ts, float step) {
+    if (!t->in_event) {
+        if (fabsf(level - t->baseline_cm) < EVENT_MIN_CM) {
+            t->baseline_seen_ts = ts;
+            return false;
+        }
+        t->in_event = true;
+        t->max_step_cm = step;
+        t->last_change_ts = ts;
+        t->stable_count = 0;
+        return false;
+    }
+
+    if (step > t->max_step_cm) {
+        t->max_step_cm = step;
+    }
+    if (step >= CHANGE_CM) {
+        t->last_change_ts = ts;
+        t->stable_count = 0;
+        return false;
+    }
+    if (++t->stable_count < LEVEL_TRACKER_SETTLE_READINGS) {
+        return false;
+    }
+
+    // Settled. A splash that came back to where it was is not an event.
+    t->in_event = false;
+    if (fabsf(level - t->baseline_cm) >= EVENT_MIN_CM) {
+        level_event_t event = {
+            .start = t->baseline_seen_ts, .end = t->last_change_ts, .start_cm = t->baseline_cm, .end_cm = level};
+
+        if (level < t->baseline_cm) {
+            event.type = LEVEL_EVENT_REFILL;
+        } else if (t->max_step_cm >= CHANGE_CM) {
+            event.type = LEVEL_EVENT_DRINK;
+        } else {
+            event.type = LEVEL_EVENT_EVAPORATION;
+            event.start = t->baseline_ts;
+            event.end = ts;
+        }
+        queue_event(t, &event);
+    }
+    t->baseline_cm = level;
+    t->baseline_ts = ts;
+    t->baseline_seen_ts = ts;
+    return true;
+}
+
+bool level_tracker_update(level_tracker_t *tracker, const reading_t *reading) {
+    float level = reading->level_cm;
+    uint32_t ts = reading->timestamp;
+    bool publish = false;
+
+    if (!tracker->has_baseline) {
+        tracker->has_baseline = true;
+        tracker->baseline_cm = level;
+        tracker->baseline_ts = ts;
+        tracker->baseline_seen_ts = ts;
+        tracker->interval_ms = tuning.min_interval_ms;
+    } else {
+        float step = fabsf(level - tracker->prev_cm);
+
+        publish = track_event(tracker, level, ts, step);
+
+        // Sample fast while the level moves, back off exponentially while it holds still
+        if (tracker->in_event || step >= CHANGE_CM) {
+            tracker->interval_ms = tuning.min_interval_ms;
+        } else if (tracker->interval_ms < tuning.max_interval_ms / 2) {
+            tracker->interval_ms *= 2;
+        } else {
+            tracker->interval_ms = tuning.max_interval_ms;
+        }
+    }
+    tracker->prev_cm = level;
+
+    if (!tracker->has_published || fabsf(level - tracker->published_cm) >= tuning.deadband_cm ||
+        ts - tracker->published_ts >= HEARTBEAT_S) {
+        publish = true;
+    }
+    if (publish) {
+        tracker->has_published = true;
+        tracker->published_cm = level;
+        tracker->published_ts = ts;
+    }
+
+    tracker->crc = tracker_crc(tracker);
+    return publish;
+}
+
+void level_tracker_tune(level_tracker_t *tracker, const level_tracker_tuning_t *new_tuning) {
+    tuning = *new_tuning;
+    if (tracker->interval_ms < tuning.min_interval_ms) {
+        tracker->interval_ms = tuning.min_interval_ms;
+    } else if (tracker->interval_ms > tuning.max_interval_ms) {
+        tracker->interval_ms = tuning.max_interval_ms;
+    }
+    tracker->crc = tracker_crc(tracker);
+}
+
+static void fix_timestamp(uint32_t *ts, uint32_t valid_from, int64_t offset_s) {
+    if (*ts != 0 && *ts < valid_from) {
+        *ts = (uint32_t)(*ts + offset_s);
+    }
+}
+
+void level_tracker_fix_timestamps(level_tracker_t *tracker, uint32_t valid_from, int64_t offset_s) {
+    fix_timestamp(&tracker->baseline_ts, valid_from, offset_s);
+    fix_timestamp(&tracker->baseline_seen_ts, valid_from, offset_s);
+    fix_timestamp(&tracker->last_change_ts, valid_from, offset_s);
+    fix_timestamp(&tracker->published_ts, valid_from, offset_s);
+    for (size_t i = 0; i < tracker->event_count; i++) {
+        level_event_t *event = &tracker->events[(tracker->event_head + i) % LEVEL_TRACKER_MAX_EVENTS];
+        fix_timestamp(&event->start, valid_from, offset_s);
+        fix_timestamp(&event->end, valid_from, offset_s);
+    }
+    tracker->crc = tracker_crc(tracker);
+}
+
+uint32_t level_tracker_interval_ms(const level_tracker_t *tracker) {
+    return tracker->interval_ms;
+}
+
+size_t level_tracker_peek_events(const level_tracker_t *tracker, level_event_t *out, size_t max) {
+    size_t n = tracker->event_count < max ? tracker->event_count : max;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = tracker->events[(tracker->event_head + i) % LEVEL_TRACKER_MAX_EVENTS];
+    }
+    return n;
+}
+
+void level_tracker_consume_events(level_tracker_t *tracker, size_t n) {
+    if (n > tracker->event_count) {
+        n = tracker->event_count;
+    }
+    tracker->event_head = (tracker->event_head + n) % LEVEL_TRACKER_MAX_EVENTS;
+    tracker->event_count -= n;
+    tracker->crc = tracker_crc(tracker);
+}
+
+const char *level_event_name(level_event_type_t type) {
+    switch (type) {
+    case LEVEL_EVENT_DRINK:
+        return "drink";
+    case LEVEL_EVENT_REFILL:
+        return "refill";
+    case LEVEL_EVENT_EVAPORATION:
+        return "evaporation";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reading_buffer.h"
+
+#define LEVEL_TRACKER_MAX_EVENTS 8
+
+/*
+ * Levels are sensor distances, so a drink or evaporation raises them and a refill lowers them.
+ *
+ * A level event starts once a reading leaves the deadband around the settled level and ends when consecutive
+ * readings agree again. Falling distance is a refill. Rising distance is a drink if any single step was fast
+ * (at least CONFIG_SAMPLING_CHANGE_MM between readings), otherwise a slow drift, i.e. evaporation.
+ */
+typedef enum {
+    LEVEL_EVENT_DRINK,
+    LEVEL_EVENT_REFILL,
+    LEVEL_EVENT_EVAPORATION,
+} level_event_type_t;
+
+typedef struct {
+    uint8_t type;   // level_event_type_t
+    uint32_t start; // Last reading at the old level (first reading of it, for evaporation)
+    uint32_t end;   // Last reading that was still changing
+    float start_cm;
+    float end_cm;
+} level_event_t;
+
+// Plain data so it can live in RTC memory across deep sleep; validated by magic and CRC
+typedef struct {
+    uint32_t magic;
+    uint32_t interval_ms;      // Until the next reading
+    bool has_baseline;
+    bool in_event;
+    bool has_published;
+    uint8_t stable_count;      // Consecutive unchanged readings during an event
+    float prev_cm;
+    float baseline_cm;         // Settled level
+    uint32_t baseline_ts;      // When the level settled there
+    uint32_t baseline_seen_ts; // Last reading still at the settled level
+    float max_step_cm;         // Largest step between readings during the current event
+    uint32_t last_change_ts;
+    float published_cm;
+    uint32_t published_ts;
+    uint8_t event_head;
+    uint8_t event_count;
+    level_event_t events[LEVEL_TRACKER_MAX_EVENTS];
+    uint32_t crc;
+} level_tracker_t;
+
+// Keep retained state if it is intact, otherwise start over. Returns true if it was kept.
+bool level_tracker_init(level_tracker_t *tracker);
+
+/*
+ * Feed one reading and adapt the sampling interval: the minimum while the level moves, doubling up to the maximum
+ * (CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN unless retuned) while it holds. Returns true if the reading should be
+ * published: it is outside the deadband of the last published level, a heartbeat is due, or it ends a level event.
+ */
+bool level_tracker_update(level_tracker_t *tracker, const reading_t *reading);
+
+uint32_t level_tracker_interval_ms(const level_tracker_t *tracker);
+
+// Once the clock syncs, shift every timestamp the unsynced clock stamped (those below valid_from) by offset_s, so
+// event spans and the heartbeat stay in wall time. Call from the task that feeds readings.
+void level_tracker_fix_timestamps(level_tracker_t *tracker, uint32_t valid_from, int64_t offset_s);
+
+// Sampling limits and publish deadband; the CONFIG_ values until retuned at runtime
+typedef struct {
+    uint32_t min_interval_ms;
+    uint32_t max_interval_ms;
+    float deadband_cm;
+} level_tracker_tuning_t;
+
+// Replace the limits and pull the pending interval into the new range. Call from the task that feeds readings.
+void level_tracker_tune(level_tracker_t *tracker, const level_tracker_tuning_t *tuning);
+
+// Copy up to max of the oldest undelivered events without removing them
+size_t level_tracker_peek_events(const level_tracker_t *tracker, level_event_t *out, size_t max);
+
+// Remove the n oldest events once they have been delivered
+void level_tracker_consume_events(level_tracker_t *tracker, size_t n);
+
+const char *level_event_name(level_event_type_t type);
@@ -5,54 +5,106 @@ ToDo:
 - Get RGB LED working
 - Get periodic distance measurement working
 */
-#include "cJSON.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
+#include "esp_app_desc.h"
+#include "esp_attr.h"
+#include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/timers.h"
+#include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "gecl-misc-util-manager.h"
 #include "gecl-mqtt-manager.h"
 #include "gecl-nvs-manager.h"
-#include "gecl-ota-manager.h"
-#include "gecl-rgb-led-manager.h"
 #include "gecl-time-sync-manager.h"
 #include "gecl-ultrasonic-manager.h"
 #include "gecl-wifi-manager.h"
 
-#define ORPHAN_TIMEOUT pdMS_TO_TICKS(7200000) // 2 hours in milliseconds
+#include "duty_cycle.h"
+#include "json_scan.h"
+#include "level_tracker.h"
+#include "metrics.h"
+#include "mqtt_reconnect.h"
+#include "ota_stream.h"
+#include "power.h"
+#include "provisioning.h"
+#include "ranging.h"
+#include "reading_buffer.h"
+#include "runtime_config.h"
+#include "startup.h"
+#include "status_led.h"
+#include "supervisor.h"
+#include "telemetry.h"
+#include "topic_router.h"
+#include "wifi_cache.h"
+
+#define READING_BATCH_MAX 8         // Readings per batched publish
+#define TIME_VALID_EPOCH 1700000000 // Anything earlier means SNTP has not synced yet
+#define OUTBOX_POLL_MS 100
+#define TIME_SYNC_GRACE_MS 30000    // How long after boot readings are held back waiting for SNTP
+#define TIME_SYNC_POLL_MS 250
+#define STARTUP_SUMMARY_TIMEOUT_MS 120000
+
+// pdMS_TO_TICKS multiplies in 32 bits and wraps past about 11.9 h at 100 Hz; runtime settings reach 7 days
+#define S_TO_TICKS(s) ((TickType_t)((uint64_t)(s) * configTICK_RATE_HZ))
+#define LONG_MS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
 
 static const char *TAG = "WATER_BOWL";
 const char *device_name = CONFIG_WIFI_HOSTNAME;
 
-TaskHandle_t ota_task_handle = NULL; // Task handle for OTA updating
+TaskHandle_t ultrasonic_task_handle = NULL;
 TimerHandle_t orphan_timer = NULL;
 
 esp_mqtt_client_handle_t mqtt_client_handle = NULL;
+volatile bool mqtt_connected = false;
 
 char mac_address[18];
 
-extern const uint8_t certificate[];
-extern const uint8_t key[];
+// Adaptive sampling, publish deadband and level events; retained across deep sleep
+static RTC_NOINIT_ATTR level_tracker_t level_tracker;
+
+// Readings taken this boot before SNTP synced are re-stamped from these once it has
+static uint32_t boot_first_seq = 0;
+static int64_t unsynced_epoch_s = 0;
+static bool boot_timestamps_fixed = false;
+
+// Per-device topics, built from the MAC address at boot
+static char device_id[13];
+static char ota_device_topic[160];
+static char ota_group_topic[160];
+static char config_topic[160];
+static char config_reported_topic[176];
+
+// Last status color shown, so a new LED map can be applied to it straight away
+static char status_color[RUNTIME_CONFIG_LED_NAME_MAX];
+
+// The device certificate and key come from the provisioning partition; the root CA is the same fleet-wide
 extern const uint8_t AmazonRootCA1_pem[];
-const uint8_t *my_cert = certificate;
-const uint8_t *my_key = key;
+const uint8_t *my_cert = NULL;
+const uint8_t *my_key = NULL;
 const uint8_t *my_root_ca = AmazonRootCA1_pem;
 
 // Callback function for timer expiration
 void orphan_timer_callback(TimerHandle_t xTimer) {
-    ESP_LOGE(TAG, "No status message received for 2 hours. Triggering reboot!");
-    error_reload(mqtt_client_handle);
+    ESP_LOGE(TAG, "No status message received for %lu s",
+             (unsigned long)(xTimerGetPeriod(xTimer) * portTICK_PERIOD_MS / 1000));
+    supervisor_report(SUPERVISOR_FAULT_ORPHAN);
 }
 
 // Function to reset the timer whenever a message is received
 void reset_orphan_timer(void) {
     if (xTimerReset(orphan_timer, 0) != pdPASS) {
         ESP_LOGE(TAG, "Orphan timer failed to reset");
-        error_reload(mqtt_client_handle);
+        supervisor_report(SUPERVISOR_FAULT_INTERNAL);
     } else {
         ESP_LOGI(TAG, "Orphan timer reset successfully");
     }
@@ -61,48 +113,28 @@ void reset_orphan_timer(void) {
 void custom_handle_mqtt_event_connected(esp_mqtt_event_handle_t event) {
     esp_mqtt_client_handle_t client = event->client;
     ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_CONNECTED");
-    int msg_id;
-
-    msg_id = esp_mqtt_client_subscribe(client, CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, 0);
-    ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, msg_id);
 
-    msg_id = esp_mqtt_client_subscribe(client, CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC, 0);
-    ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC, msg_id);
+    mqtt_reconnect_on_connected();
+    supervisor_signal(SUPERVISOR_SIGNAL_CONNECTED);
+    duty_cycle_note_connected();
+    metrics_mark(METRIC_MARK_MQTT_CONNECTED, NULL);
+    startup_done(STARTUP_STAGE_MQTT);
+    topic_router_subscribe_all(client);
+
+    // Wake the reading task so anything buffered during the outage goes out now
+    mqtt_connected = true;
+    if (ultrasonic_task_handle != NULL) {
+        xTaskNotifyGive(ultrasonic_task_handle);
+    }
 }
 
 void custom_handle_mqtt_event_disconnected(esp_mqtt_event_handle_t event) {
     ESP_LOGI(TAG, "Custom handler: MQTT_EVENT_DISCONNECTED");
-    if (ota_task_handle != NULL) {
-        vTaskDelete(ota_task_handle);
-        ota_task_handle = NULL;
-    }
-    // Reconnect logic
-    int retry_count = 0;
-    const int max_retries = 5;
-    const int retry_delay_ms = 5000;
-    esp_err_t err;
-    esp_mqtt_client_handle_t client = event->client;
-
-    // Check if the network is connected before attempting reconnection
-    if (wifi_active()) {
-        do {
-            ESP_LOGI(TAG, "Attempting to reconnect, retry %d/%d", retry_count + 1, max_retries);
-            err = esp_mqtt_client_reconnect(client);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to reconnect MQTT client, retrying in %d seconds...", retry_delay_ms / 1000);
-                vTaskDelay(pdMS_TO_TICKS(retry_delay_ms)); // Delay for 5 seconds
-                retry_count++;
-            }
-        } while (err != ESP_OK && retry_count < max_retries);
-
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to reconnect MQTT client after %d retries. Restarting", retry_count);
-            error_reload(mqtt_client_handle);
-        }
-    } else {
-        ESP_LOGE(TAG, "Network not connected, skipping MQTT reconnection");
-        error_reload(mqtt_client_handle);
-    }
+    mqtt_connected = false;
+    supervisor_signal(SUPERVISOR_SIGNAL_DISCONNECTED);
+    metrics_on_disconnected();
+    // Reconnect from a backoff timer so the event loop is never stalled; readings keep buffering meanwhile
+    mqtt_reconnect_on_disconnected(event->client);
 }
 
 void to_uppercase(char *str) {
@@ -112,118 +144,207 @@ void to_uppercase(char *str) {
     }
 }
 
-void set_waterbowl_color(const char *color) {
+// The color map is part of the runtime config; see runtime_config.h for the defaults
+void set_waterbowl_color(char *color) {
+    runtime_led_t led;
+
     to_uppercase(color);
+    if (!runtime_config_led(color, &led)) {
+        ESP_LOGW(TAG, "Unknown color: %s", color);
+        return;
+    }
+    snprintf(status_color, sizeof(status_color), "%s", led.name);
 
-    if (strcmp(color, "RED") == 0) {
-        set_rgb_led_enumerated_values(255, 0, 0, LED_STATE_BLINK, 1000);
-    } else if (strcmp(color, "GREEN") == 0) {
-        set_rgb_led_enumerated_values(0, 128, 0, LED_STATE_SOLID, 0);
-    } else if (strcmp(color, "YELLOW") == 0) {
-        set_rgb_led_enumerated_values(255, 255, 0, LED_STATE_SOLID, 0);
-    } else if (strcmp(color, "BLACK") == 0) {
-        set_rgb_led_enumerated_values(0, 0, 255, LED_STATE_BLINK, 1000);
+    if (led.red == 0 && led.green == 0 && led.blue == 0) {
+        status_led_set(0, 0, 0, LED_STATE_OFF, 0);
+    } else if (led.blink_ms > 0) {
+        status_led_set(led.red, led.green, led.blue, LED_STATE_BLINK, led.blink_ms);
     } else {
-        ESP_LOGW(TAG, "Unknown color: %s", color);
+        status_led_set(led.red, led.green, led.blue, LED_STATE_SOLID, 0);
     }
 }
 
 void custom_handle_mqtt_event_subscribe(esp_mqtt_event_handle_t event) {
-    // Handle the status response
-    cJSON *json = cJSON_Parse(event->data);
-    if (json == NULL) {
-        ESP_LOGE(TAG, "Failed to parse JSON");
-        error_reload(mqtt_client_handle);
+    // Handle the status response. Only the LED field is pulled out, straight from the event buffer.
+    json_span_t state;
+    char led_state[16];
+
+    if (!json_scan_find(event->data, event->data_len, "LED", &state) ||
+        !json_span_to_string(&state, led_state, sizeof(led_state))) {
+        ESP_LOGE(TAG, "Failed to parse JSON, dropping message");
+        supervisor_report(SUPERVISOR_FAULT_BAD_MESSAGE);
     } else {
-        cJSON *state = cJSON_GetObjectItem(json, "LED");
-        const char *led_state = cJSON_GetStringValue(state);
-        assert(led_state != NULL);
         set_waterbowl_color(led_state);
-        cJSON_Delete(json);
     }
 }
 
-bool extract_ota_url_from_event(esp_mqtt_event_handle_t event, char *local_mac_address, char *ota_url) {
-    bool success = false;
-    cJSON *root = cJSON_Parse(event->data);
-    cJSON *host_key = cJSON_GetObjectItem(root, local_mac_address);
-    const char *host_key_value = cJSON_GetStringValue(host_key);
+#if CONFIG_OTA_LEGACY_FLEET_MAP
+bool extract_ota_url_from_event(esp_mqtt_event_handle_t event, char *local_mac_address, char *ota_url,
+                                size_t ota_url_size) {
+    json_span_t host_key_value;
 
-    if (!host_key || !host_key_value) {
+    if (!json_scan_find(event->data, event->data_len, local_mac_address, &host_key_value)) {
         ESP_LOGW(TAG, "'%s' MAC address key not found in JSON", local_mac_address);
-    } else {
-        size_t url_len = strlen(host_key_value);
-        strncpy(ota_url, host_key_value, url_len);
-        ota_url[url_len] = '\0'; // Manually set the null terminator
-        success = true;
+        return false;
+    }
+    if (!json_span_to_string(&host_key_value, ota_url, ota_url_size)) {
+        ESP_LOGW(TAG, "'%s' MAC address value is not a URL that fits %u bytes", local_mac_address,
+                 (unsigned)ota_url_size);
+        return false;
     }
+    return true;
+}
+#endif
+
+// Shared by the targeted manifest and the legacy fleet map
+static void start_ota_update(const ota_stream_request_t *request) {
+    status_led_set_named("LED_BLINK_GREEN");
+    metrics_count(METRIC_OTA_STARTED);
 
-    cJSON_Delete(root); // Free JSON object
-    return success;
+    // The OTA task keeps its own copy of the request
+    if (ota_stream_start(request) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create OTA task");
+        supervisor_report(SUPERVISOR_FAULT_INTERNAL);
+    }
 }
 
+// Per-device or per-group manifest: parse cost does not depend on fleet size
+void handle_ota_manifest_topic(esp_mqtt_event_handle_t event) {
+    ota_stream_request_t request = {.mqtt_client = event->client};
+    char version[32];
+
+    if (ota_stream_in_progress()) {
+        ESP_LOGW(TAG, "OTA update already in progress, skipping OTA update");
+        return;
+    }
+    if (!ota_stream_parse_manifest(event->data, event->data_len, &request, version, sizeof(version))) {
+        return;
+    }
+    if (version[0] != '\0' && strcmp(version, esp_app_get_description()->version) == 0) {
+        ESP_LOGI(TAG, "Already running %s, skipping OTA update", version);
+        return;
+    }
+
+    ESP_LOGI(TAG, "OTA manifest: version %s, %lu bytes", version[0] ? version : "(unspecified)",
+             (unsigned long)request.size);
+    start_ota_update(&request);
+}
+
+#if CONFIG_OTA_LEGACY_FLEET_MAP
 void custom_handle_mqtt_event_ota(esp_mqtt_event_handle_t event, char *my_mac_address) {
-    if (ota_task_handle != NULL) {
-        eTaskState task_state = eTaskGetState(ota_task_handle);
-        if (task_state != eDeleted) {
-            char log_message[256]; // Adjust the size according to your needs
-            snprintf(log_message, sizeof(log_message),
-                     "OTA task is already running or not yet cleaned up, skipping OTA update. task_state=%d",
-                     task_state);
-
-            ESP_LOGW(TAG, "%s", log_message);
-            return;
-        } else {
-            // Clean up task handle if it has been deleted
-            ota_task_handle = NULL;
-        }
-    } else {
-        ESP_LOGI(TAG, "OTA task handle is NULL");
+    if (ota_stream_in_progress()) {
+        ESP_LOGW(TAG, "OTA update already in progress, skipping OTA update");
+        return;
     }
 
     // Parse the message and get any URL associated with our MAC address
     assert(event->data != NULL);
     assert(event->data_len > 0);
 
-    ota_config_t ota_config;
-    ota_config.mqtt_client = event->client;
+    ota_stream_request_t request = {.mqtt_client = event->client};
 
-    if (!extract_ota_url_from_event(event, my_mac_address, ota_config.url)) {
+    if (!extract_ota_url_from_event(event, my_mac_address, request.url, sizeof(request.url))) {
         ESP_LOGW(TAG, "OTA URL not found in event data");
         return;
     }
 
-    set_rgb_led_named_color("LED_BLINK_GREEN");
+    start_ota_update(&request);
+}
 
-    // Pass the allocated URL string to the OTA task
-    if (xTaskCreate(&ota_task, "ota_task", 8192, (void *)&ota_config, 5, &ota_task_handle) != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create OTA task. Restarting...");
-        error_reload(mqtt_client_handle);
-    }
+void handle_ota_topic(esp_mqtt_event_handle_t event) {
+    // Use the global mac_address variable to pass the MAC address to the OTA function
+    custom_handle_mqtt_event_ota(event, mac_address);
 }
+#endif
 
 void custom_handle_mqtt_event_data(esp_mqtt_event_handle_t event) {
 
     ESP_LOGW(TAG, "Received topic %.*s", event->topic_len, event->topic);
+    metrics_count(METRIC_MESSAGES_IN);
 
     // Reset the orphan timer whenever a message is received
     reset_orphan_timer();
 
-    if (ota_task_handle != NULL) {
-        ESP_LOGW(TAG, "OTA task is running, skipping message handling");
-        return;
+    topic_route_result_t routed = topic_router_dispatch(event);
+    if (routed == TOPIC_ROUTE_UNROUTED) {
+        metrics_count(METRIC_MESSAGES_UNROUTED);
+        ESP_LOGE(TAG, "Un-Handled topic %.*s", event->topic_len, event->topic);
+    } else if (routed == TOPIC_ROUTE_HANDLED) {
+        // A dropped fragment proves nothing about the subscription, so only handled messages count
+        supervisor_signal(SUPERVISOR_SIGNAL_MESSAGE);
     }
+    // Handlers run on the MQTT task, so this is the deepest its stack gets on our account
+    metrics_sample_stack(METRIC_STACK_MQTT);
+}
 
-    if (strncmp(event->topic, CONFIG_SUBSCRIBE_LED_COLOR_TOPIC, event->topic_len) == 0) {
-        custom_handle_mqtt_event_subscribe(event);
-    } else if (strncmp(event->topic, CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC, event->topic_len) == 0) {
-        // Use the global mac_address variable to pass the MAC address to the OTA function
-        custom_handle_mqtt_event_ota(event, mac_address);
-    } else {
-        ESP_LOGE(TAG, "Un-Handled topic %.*s", event->topic_len, event->topic);
+// Settings the ultrasonic task owns are picked up there; the rest takes effect here, on the MQTT task
+static void apply_runtime_config(void) {
+    runtime_config_t config;
+    runtime_config_get(&config);
+
+    if (xTimerChangePeriod(orphan_timer, S_TO_TICKS(config.orphan_timeout_s), 0) != pdPASS) {
+        ESP_LOGW(TAG, "Orphan timeout not changed");
+    }
+    if (status_color[0] != '\0') {
+        char color[RUNTIME_CONFIG_LED_NAME_MAX];
+        runtime_led_t led;
+
+        snprintf(color, sizeof(color), "%s", status_color); // set_waterbowl_color rewrites status_color
+        if (runtime_config_led(color, &led)) {
+            set_waterbowl_color(color);
+        } else {
+            // Keeping the old pattern would show a state the new map no longer has
+            ESP_LOGW(TAG, "%s is no longer mapped, LED off until the next status", color);
+            status_color[0] = '\0';
+            status_led_set(0, 0, 0, LED_STATE_OFF, 0);
+        }
+    }
+    if (ultrasonic_task_handle != NULL) {
+        xTaskNotifyGive(ultrasonic_task_handle);
     }
 }
 
+// Desired-state document on <config topic>/<device id>; the outcome goes back, retained, on .../reported
+void handle_config_topic(esp_mqtt_event_handle_t event) {
+    char error[64];
+    char payload[160];
+
+    runtime_config_result_t result = runtime_config_apply(event->data, event->data_len, error, sizeof(error));
+    if (result == RUNTIME_CONFIG_APPLIED) {
+        apply_runtime_config();
+    } else if (result == RUNTIME_CONFIG_CURRENT) {
+        return; // The retained document again after a reconnect; already reported
+    }
+
+    int len = snprintf(payload, sizeof(payload), "{\"status\":\"%s\",\"version\":%lu,\"error\":\"%s\"}",
+                       runtime_config_result_name(result), (unsigned long)runtime_config_version(), error);
+    if (esp_mqtt_client_publish(event->client, config_reported_topic, payload, len, 1, 1) < 0) {
+        ESP_LOGW(TAG, "Config report not published");
+    }
+}
+
+// <topic>/<mac without colons> for this bowl, <ota topic>/group/<group> for its group
+static void build_device_topics(void) {
+    size_t n = 0;
+
+    for (const char *p = mac_address; *p && n < sizeof(device_id) - 1; p++) {
+        if (*p != ':') {
+            device_id[n++] = tolower((unsigned char)*p);
+        }
+    }
+    device_id[n] = '\0';
+
+    const provisioning_t *prov = provisioning_get();
+    snprintf(ota_device_topic, sizeof(ota_device_topic), "%s/%s", prov->ota_topic, device_id);
+    ota_group_topic[0] = '\0';
+    if (strlen(prov->ota_group) > 0) {
+        snprintf(ota_group_topic, sizeof(ota_group_topic), "%s/group/%s", prov->ota_topic, prov->ota_group);
+    }
+    snprintf(config_topic, sizeof(config_topic), "%s/%s", prov->config_topic, device_id);
+    snprintf(config_reported_topic, sizeof(config_reported_topic), "%s/reported", config_topic);
+    ESP_LOGI(TAG, "OTA manifest topic: %s, config topic: %s", ota_device_topic, config_topic);
+}
+
 void custom_handle_mqtt_event_error(esp_mqtt_event_handle_t event) {
     ESP_LOGE(TAG, "Custom handler: MQTT_EVENT_ERROR");
     if (event->error_handle->error_type == MQTT_ERROR_TYPE_ESP_TLS) {
@@ -235,46 +356,317 @@ void custom_handle_mqtt_event_error(esp_mqtt_event_handle_t event) {
     } else {
         ESP_LOGE(TAG, "Unknown error type: 0x%x", event->error_handle->error_type);
     }
-    error_reload(mqtt_client_handle);
+    supervisor_report(SUPERVISOR_FAULT_MQTT_ERROR);
 }
 
-void ultrasonic_read_task(void *pvParameter) {
-    while (1) {
-        // Ensure sensor is initialized
-        if (!hcsr04_is_initialized()) {
-            hcsr04_init();
-        }
+// The unsynced clock ran from unsynced_epoch_s at boot, so the wall time of a reading it stamped is known
+// as soon as SNTP is
+static void fix_boot_timestamps(void) {
+    if (boot_timestamps_fixed || !startup_is_done(STARTUP_STAGE_TIME)) {
+        return;
+    }
+    boot_timestamps_fixed = true;
 
-        // Read the range in cm
-        float distance = hcsr04_get_range();
+    int64_t offset_s = (int64_t)time(NULL) - esp_timer_get_time() / 1000000 - unsynced_epoch_s;
+    size_t fixed = reading_buffer_fix_timestamps(boot_first_seq, offset_s);
+    if (fixed > 0) {
+        ESP_LOGI(TAG, "Re-stamped %u readings taken before the clock synced", (unsigned)fixed);
+    }
+    level_tracker_fix_timestamps(&level_tracker, TIME_VALID_EPOCH, offset_s);
+}
 
-        // Prepare the payload (you can format it however you like)
-        char payload[100];
-        snprintf(payload, sizeof(payload), "{\"water_level\": \"%.1f\", \"hostname\": \"%s\" }", distance,
-                 CONFIG_LOCATION);
+// Drain the reading buffer oldest-first in batches. Readings stay buffered until the publish is accepted.
+static void publish_pending_readings(void) {
+    static char payload[1024];
+    reading_t batch[READING_BATCH_MAX];
+
+    // Shortly after boot, hold readings back until they can carry real timestamps
+    if (!startup_is_done(STARTUP_STAGE_TIME) && esp_timer_get_time() < (int64_t)TIME_SYNC_GRACE_MS * 1000) {
+        return;
+    }
+    fix_boot_timestamps();
+
+    while (mqtt_connected && reading_buffer_count() > 0) {
+        size_t count = reading_buffer_peek(batch, READING_BATCH_MAX);
+        int len = telemetry_encode(batch, count, payload, sizeof(payload));
+
+        // Shrink the batch until it fits the payload buffer
+        while (len >= (int)sizeof(payload) && count > 1) {
+            count--;
+            len = telemetry_encode(batch, count, payload, sizeof(payload));
+        }
 
         // Publish to MQTT topic
-        int msg_id = esp_mqtt_client_publish(mqtt_client_handle, CONFIG_PUBLISH_WATER_LEVEL_TOPIC, payload, 0, 1, 0);
+        int msg_id = esp_mqtt_client_publish(mqtt_client_handle, telemetry_topic(), payload, len, 1, 0);
         if (msg_id == -1) {
-            ESP_LOGE("MQTT", "Failed to publish message");
+            metrics_count(METRIC_PUBLISH_FAILED);
+            ESP_LOGE("MQTT", "Failed to publish message, %u readings kept for retry", (unsigned)reading_buffer_count());
+            reading_buffer_checkpoint();
+            break;
+        }
+
+        metrics_count(METRIC_PUBLISH_OK);
+        metrics_publish_sent(msg_id);
+        ESP_LOGI("MQTT", "Published %u readings (%d bytes) to %s", (unsigned)count, len, telemetry_topic());
+        uint32_t boot_ms;
+        if (metrics_mark(METRIC_MARK_FIRST_PUBLISH, &boot_ms)) {
+            ESP_LOGI(TAG, "Boot to first publish: %lu ms", (unsigned long)boot_ms);
+        }
+        reading_buffer_consume(count);
+    }
+
+    // Offline (an outage, or an unprovisioned bowl) nothing is even attempted; keep a bounded copy meanwhile
+    if (!mqtt_connected) {
+        reading_buffer_checkpoint();
+    }
+}
+
+// Events are few and matter more than any single reading, so each goes out on its own at QoS 1
+static void publish_pending_events(void) {
+    char payload[192];
+    level_event_t event;
+
+    // Same hold-back as readings, so an event is not sent with a span from the unsynced clock
+    if (!boot_timestamps_fixed && esp_timer_get_time() < (int64_t)TIME_SYNC_GRACE_MS * 1000) {
+        return;
+    }
+
+    while (mqtt_connected && level_tracker_peek_events(&level_tracker, &event, 1) == 1) {
+        int len = telemetry_encode_event(&event, payload, sizeof(payload));
+        int msg_id = esp_mqtt_client_publish(mqtt_client_handle, CONFIG_PUBLISH_LEVEL_EVENT_TOPIC, payload, len, 1, 0);
+        if (msg_id == -1) {
+            ESP_LOGE("MQTT", "Failed to publish level event, kept for retry");
+            break;
+        }
+        metrics_count(METRIC_LEVEL_EVENTS);
+        metrics_publish_sent(msg_id);
+        ESP_LOGI("MQTT", "Published %s event", level_event_name(event.type));
+        level_tracker_consume_events(&level_tracker, 1);
+    }
+}
+
+// Hand retuned sampling limits to the level tracker; runs where readings are fed to it, so it never races them
+static void apply_sampling_config(void) {
+    static uint32_t applied_version = UINT32_MAX;
+    runtime_config_t config;
+
+    if (runtime_config_version() == applied_version) {
+        return;
+    }
+    runtime_config_get(&config);
+    applied_version = config.version;
+    level_tracker_tune(&level_tracker, &(level_tracker_tuning_t){
+                                           .min_interval_ms = config.interval_min_s * 1000,
+                                           .max_interval_ms = config.interval_max_s * 1000,
+                                           .deadband_cm = config.deadband_mm / 10.0f,
+                                       });
+}
+
+// Fire a burst of pings and queue the filtered reading
+static void take_reading(void) {
+    ranging_result_t result;
+
+    int64_t burst_start = esp_timer_get_time();
+    bool measured = ranging_measure(&result);
+    metrics_observe(METRIC_HIST_RANGING_MS, (esp_timer_get_time() - burst_start) / 1000);
+
+    if (measured) {
+        time_t wall_clock = time(NULL);
+        reading_t reading = {
+            .timestamp = (uint32_t)wall_clock,
+            .level_cm = result.distance_cm,
+            .spread_cm = result.spread_cm,
+            .confidence = result.confidence,
+            .flags = wall_clock < TIME_VALID_EPOCH ? READING_FLAG_NO_TIME : 0,
+        };
+        metrics_count(METRIC_READINGS);
+
+        // Only changes past the deadband, heartbeats and settled levels after an event go out
+        if (level_tracker_update(&level_tracker, &reading)) {
+            reading_buffer_push(&reading);
         } else {
-            ESP_LOGI("MQTT", "Published message: %s", payload);
+            metrics_count(METRIC_READINGS_SUPPRESSED);
         }
+    } else {
+        metrics_count(METRIC_RANGING_FAILURES);
+        ESP_LOGW(TAG, "No trustworthy reading this interval, skipping publish");
+    }
+    startup_done(STARTUP_STAGE_SENSOR);
+}
 
-        // Delay for configured time interval (convert minutes to ticks)
-        vTaskDelay(CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN * 60 * 1000 / portTICK_PERIOD_MS);
+// Runs alongside the MQTT connect rather than ahead of it; only the reading timestamps depend on it
+static void time_sync_task(void *pvParameter) {
+    startup_begin(STARTUP_STAGE_TIME);
+    if (time(NULL) >= TIME_VALID_EPOCH) {
+        startup_done(STARTUP_STAGE_TIME); // Kept across a software reset or deep sleep
+    }
+
+    startup_wait(STARTUP_BIT(STARTUP_STAGE_WIFI), portMAX_DELAY);
+    init_time_sync();
+    while (time(NULL) < TIME_VALID_EPOCH) {
+        vTaskDelay(pdMS_TO_TICKS(TIME_SYNC_POLL_MS));
+    }
+    startup_done(STARTUP_STAGE_TIME);
+
+    // Release whatever the reading task held back
+    if (ultrasonic_task_handle != NULL) {
+        xTaskNotifyGive(ultrasonic_task_handle);
+    }
+    vTaskDelete(NULL);
+}
+
+static void wifi_got_ip_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    startup_done(STARTUP_STAGE_WIFI);
+}
+
+#if CONFIG_DUTY_CYCLE_DEEP_SLEEP
+// The rest of a wake that brought up the network: drain the buffer, give retained commands and the PUBACKs a
+// moment to arrive, then go back to sleep. An OTA download keeps the bowl awake until it restarts or fails.
+static void finish_connected_wake(void) {
+    const int64_t connect_deadline = esp_timer_get_time() + (int64_t)CONFIG_DUTY_CYCLE_CONNECT_TIMEOUT_S * 1000000;
+
+    if (!startup_wait(STARTUP_BIT(STARTUP_STAGE_MQTT), pdMS_TO_TICKS(CONFIG_DUTY_CYCLE_CONNECT_TIMEOUT_S * 1000))) {
+        ESP_LOGW(TAG, "MQTT not connected after %d s, keeping %u readings for the next wake",
+                 CONFIG_DUTY_CYCLE_CONNECT_TIMEOUT_S, (unsigned)reading_buffer_count());
+    } else {
+        int64_t grace_left_ms = TIME_SYNC_GRACE_MS - esp_timer_get_time() / 1000;
+        if (grace_left_ms > 0) {
+            startup_wait(STARTUP_BIT(STARTUP_STAGE_TIME), pdMS_TO_TICKS(grace_left_ms));
+        }
+    }
+    publish_pending_readings();
+    publish_pending_events();
+
+    const int64_t linger_deadline = esp_timer_get_time() + (int64_t)CONFIG_DUTY_CYCLE_LINGER_MS * 1000;
+    while (mqtt_connected || ota_stream_in_progress()) {
+        int64_t now = esp_timer_get_time();
+        bool acks_pending = esp_mqtt_client_get_outbox_size(mqtt_client_handle) > 0 && now < connect_deadline;
+
+        if (now >= linger_deadline && !acks_pending && !ota_stream_in_progress()) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(OUTBOX_POLL_MS));
+    }
+
+    esp_mqtt_client_stop(mqtt_client_handle);
+    duty_cycle_sleep(level_tracker_interval_ms(&level_tracker));
+}
+#endif
+
+void ultrasonic_read_task(void *pvParameter) {
+    // The interval adapts to how fast the level is changing; the first reading is taken straight away
+    TickType_t interval = 0;
+    TickType_t last_reading = xTaskGetTickCount();
+
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+
+        if (now - last_reading >= interval) {
+            last_reading = now;
+            take_reading();
+        }
+        // Re-read every pass: a config change wakes the task and may have moved the interval
+        apply_sampling_config();
+        interval = LONG_MS_TO_TICKS(level_tracker_interval_ms(&level_tracker));
+
+        publish_pending_readings();
+        publish_pending_events();
+        metrics_sample_stack(METRIC_STACK_ULTRASONIC);
+
+        // Sleep until the next reading is due, or until a reconnect or the clock sync asks for a drain
+        TickType_t elapsed = xTaskGetTickCount() - last_reading;
+        TickType_t wait = elapsed < interval ? interval - elapsed : 0;
+        int64_t grace_left_ms = TIME_SYNC_GRACE_MS - esp_timer_get_time() / 1000;
+        if (grace_left_ms > 0 && pdMS_TO_TICKS(grace_left_ms) < wait) {
+            wait = pdMS_TO_TICKS(grace_left_ms) + 1; // Publish untimed readings once the grace runs out
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
 
 void app_main() {
+    startup_init();
+    if (power_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Running without automatic light sleep");
+    }
+    // Until this runs, any fault restarts the device on the spot
+    if (supervisor_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the recovery supervisor");
+    }
+
+    startup_begin(STARTUP_STAGE_NVS);
     init_nvs();
+    reading_buffer_init();
+    duty_cycle_init();
+    if (!level_tracker_init(&level_tracker)) {
+        ESP_LOGI(TAG, "No retained level history, starting over");
+    }
+    runtime_config_init();
+    apply_sampling_config();
+    bool provisioned = provisioning_load() == ESP_OK;
+    device_name = provisioning_get()->hostname;
+    my_cert = (const uint8_t *)provisioning_get()->certificate;
+    my_key = (const uint8_t *)provisioning_get()->private_key;
+    startup_done(STARTUP_STAGE_NVS);
+
+    boot_first_seq = reading_buffer_next_seq();
+    unsynced_epoch_s = time(NULL) - esp_timer_get_time() / 1000000;
+
+    startup_begin(STARTUP_STAGE_LED);
+    status_led_init();
+    if (provisioned) {
+        status_led_set_named("LED_BLINK_WHITE");
+    } else {
+        status_led_set(255, 0, 0, LED_STATE_BLINK, 250);
+    }
+    startup_done(STARTUP_STAGE_LED);
+
+    // The sensor needs nothing from the network: the first reading is buffered while Wi-Fi comes up
+    startup_begin(STARTUP_STAGE_SENSOR);
+#if CONFIG_DUTY_CYCLE_DEEP_SLEEP
+    // Range before touching the radio; most wakes end right here
+    take_reading();
+    if (!provisioned || !duty_cycle_connect_due()) {
+        duty_cycle_sleep(level_tracker_interval_ms(&level_tracker));
+    }
+#else
+    xTaskCreate(&ultrasonic_read_task, "ultrasonic_read_task", 4096, NULL, 5, &ultrasonic_task_handle);
+#endif
+
+    // Without credentials there is nothing to connect to; keep ranging and buffering until the bowl is provisioned
+    if (!provisioned) {
+        ESP_LOGE(TAG, "Not provisioned; see scripts/provision/provision_bowl.sh. Staying offline");
+        return;
+    }
 
+    startup_begin(STARTUP_STAGE_WIFI);
     init_wifi();
+    if (esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_got_ip_handler, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to watch for an IP address");
+    }
+    if (wifi_active()) {
+        startup_done(STARTUP_STAGE_WIFI);
+    }
+    power_tune_wifi();
+#if CONFIG_WIFI_FAST_RECONNECT
+    if (wifi_cache_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Wi-Fi reconnect cache unavailable");
+    }
+#endif
 
     get_device_mac_address(mac_address);
     ESP_LOGI(TAG, "MAC Address: %s", mac_address);
 
-    init_time_sync();
+    topic_router_register(provisioning_get()->led_topic, 0, custom_handle_mqtt_event_subscribe);
+    build_device_topics();
+    topic_router_register(config_topic, 1, handle_config_topic);
+    topic_router_register(ota_device_topic, 0, handle_ota_manifest_topic);
+    if (ota_group_topic[0] != '\0') {
+        topic_router_register(ota_group_topic, 0, handle_ota_manifest_topic);
+    }
+#if CONFIG_OTA_LEGACY_FLEET_MAP
+    topic_router_register(provisioning_get()->ota_topic, 0, handle_ota_topic);
+#endif
 
     mqtt_set_event_connected_handler(custom_handle_mqtt_event_connected);
     mqtt_set_event_disconnected_handler(custom_handle_mqtt_event_disconnected);
@@ -283,31 +675,63 @@ void app_main() {
 
     // ESP_LOGI(TAG, "Cert size: %d, Key size: %d", sizeof(certificate), sizeof(key));
 
-    mqtt_config_t config = {
-        .root_ca = my_root_ca, .certificate = my_cert, .private_key = my_key, .broker_uri = CONFIG_IOT_ENDPOINT};
-
-    mqtt_client_handle = init_mqtt(&config);
+    if (mqtt_reconnect_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT reconnect timer");
+        metrics_note_restart(METRIC_RESTART_INTERNAL);
+        error_reload(NULL);
+    }
 
-    init_rgb_led();
+    if (xTaskCreate(&time_sync_task, "time_sync_task", 3072, NULL, 3, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create time sync task");
+        metrics_note_restart(METRIC_RESTART_INTERNAL);
+        error_reload(NULL);
+    }
 
-    set_rgb_led_named_color("LED_BLINK_WHITE");
-    // Create an orphan timer to trigger a notification if no message is received for 2 hours
-    orphan_timer = xTimerCreate("orphan_timer", ORPHAN_TIMEOUT, pdFALSE, (void *)0, orphan_timer_callback);
+    // init_mqtt may hold on to this after app_main returns
+    static mqtt_config_t config;
+    config = (mqtt_config_t){
+        .root_ca = my_root_ca,
+        .certificate = my_cert,
+        .private_key = my_key,
+        .broker_uri = provisioning_get()->broker_uri,
+    };
+
+    // Create an orphan timer to trigger a notification if no status message arrives for the orphan timeout.
+    // It must exist before init_mqtt: a retained status message can arrive as soon as the client subscribes.
+    runtime_config_t runtime_config;
+    runtime_config_get(&runtime_config);
+    orphan_timer = xTimerCreate("orphan_timer", S_TO_TICKS(runtime_config.orphan_timeout_s), pdFALSE,
+                                (void *)0, orphan_timer_callback);
 
     if (orphan_timer == NULL) {
         ESP_LOGE(TAG, "Failed to create notification timer");
-        error_reload(mqtt_client_handle);
+        metrics_note_restart(METRIC_RESTART_INTERNAL);
+        error_reload(NULL);
     }
 
     // Start the timer when the system boots
     if (xTimerStart(orphan_timer, 0) != pdPASS) {
         ESP_LOGE(TAG, "Failed to start notification timer");
-        error_reload(mqtt_client_handle);
+        metrics_note_restart(METRIC_RESTART_INTERNAL);
+        error_reload(NULL);
     }
 
-    xTaskCreate(&ultrasonic_read_task, "ultrasonic_read_task", 4096, NULL, 5, NULL);
+    startup_begin(STARTUP_STAGE_MQTT);
+    mqtt_client_handle = init_mqtt(&config);
+    supervisor_attach_mqtt(mqtt_client_handle);
+    power_tune_mqtt(mqtt_client_handle, &config);
+
+    if (metrics_start(mqtt_client_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create metrics task");
+    }
 
-    while (true) {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+#if CONFIG_DUTY_CYCLE_DEEP_SLEEP
+    finish_connected_wake();
+#else
+    if (!startup_wait(STARTUP_ALL_BITS, pdMS_TO_TICKS(STARTUP_SUMMARY_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "Startup incomplete after %d s", STARTUP_SUMMARY_TIMEOUT_MS / 1000);
     }
+    startup_log_summary();
+    // Nothing left for the main task; returning frees it instead of waking it every second
+#endif
 }
@@ -0,0 +1,314 @@
+#include "metrics.h"
+
+#include "esp_app_desc.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <assert.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mqtt_reconnect.h"
+#include "provisioning.h"
+#include "reading_buffer.h"
+#include "runtime_config.h"
+#include "startup.h"
+#include "supervisor.h"
+
+#define METRICS_RESTART_MAGIC 0x574d5231 // "WMR1"
+#define METRICS_HIST_BUCKETS 9
+#define METRICS_PENDING_ACKS 8
+#define METRICS_ACK_EXPIRY_US (30 * 1000000LL) // esp-mqtt drops unacknowledged messages from its outbox after 30 s
+#define METRICS_FIRST_REPORT_S 60 // Report soon after boot so a restart cause shows up quickly
+
+static const char *TAG = "METRICS";
+
+typedef struct {
+    atomic_uint_least32_t buckets[METRICS_HIST_BUCKETS];
+    atomic_uint_least32_t count;
+    atomic_uint_least32_t sum_ms;
+    atomic_uint_least32_t max_ms;
+} histogram_t;
+
+typedef struct {
+    int msg_id;
+    int64_t sent_us;
+} pending_ack_t;
+
+static const uint32_t bucket_bounds_ms[METRICS_HIST_BUCKETS - 1] = {25, 50, 100, 250, 500, 1000, 2500, 5000};
+
+static const char *const counter_names[] = {
+    "readings", "suppressed", "ranging_failures", "publish_ok", "publish_failed", "publish_acked", "messages_in",
+    "unrouted", "ota", "events", "faults",
+};
+static_assert(sizeof(counter_names) / sizeof(counter_names[0]) == METRIC_COUNTER_COUNT, "counter name missing");
+
+static const char *const stack_names[] = {"ultrasonic", "ota", "mqtt", "metrics"};
+static_assert(sizeof(stack_names) / sizeof(stack_names[0]) == METRIC_STACK_COUNT, "stack name missing");
+
+static const char *const histogram_names[] = {"ranging_ms", "publish_ack_ms", "wifi_reconnect_ms",
+                                              "mqtt_reconnect_ms", "recovery_ms"};
+static_assert(sizeof(histogram_names) / sizeof(histogram_names[0]) == METRIC_HIST_COUNT, "histogram name missing");
+
+static const char *const mark_names[] = {"wifi", "mqtt", "publish"};
+static_assert(sizeof(mark_names) / sizeof(mark_names[0]) == METRIC_MARK_COUNT, "mark name missing");
+
+static const char *const restart_cause_names[] = {
+    "none", "orphan_timer", "mqtt_error", "mqtt_give_up", "bad_message", "internal", "ota",
+};
+static_assert(sizeof(restart_cause_names) / sizeof(restart_cause_names[0]) == METRIC_RESTART_OTA + 1,
+              "restart cause name missing");
+
+static atomic_uint_least32_t counters[METRIC_COUNTER_COUNT];
+static atomic_uint_least32_t stack_free[METRIC_STACK_COUNT];
+static histogram_t histograms[METRIC_HIST_COUNT];
+static atomic_uint_least32_t marks_ms[METRIC_MARK_COUNT]; // 0 until reached
+
+static pending_ack_t pending_acks[METRICS_PENDING_ACKS];
+static size_t next_pending = 0;
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Written just before a deliberate restart, read once on the next boot
+static RTC_NOINIT_ATTR uint32_t restart_magic;
+static RTC_NOINIT_ATTR uint32_t restart_cause;
+static metric_restart_cause_t last_restart_cause = METRIC_RESTART_NONE;
+
+static esp_mqtt_client_handle_t metrics_client = NULL;
+
+void metrics_count(metric_counter_t counter) {
+    atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+void metrics_observe(metric_histogram_t histogram, uint32_t value_ms) {
+    histogram_t *h = &histograms[histogram];
+    size_t bucket = 0;
+
+    while (bucket < METRICS_HIST_BUCKETS - 1 && value_ms > bucket_bounds_ms[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ms, value_ms, memory_order_relaxed);
+
+    uint_least32_t max = atomic_load_explicit(&h->max_ms, memory_order_relaxed);
+    while (value_ms > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max_ms, &max, value_ms, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+bool metrics_mark(metric_mark_t mark, uint32_t *elapsed_ms) {
+    uint_least32_t now_ms = esp_timer_get_time() / 1000;
+    uint_least32_t unset = 0;
+
+    if (now_ms == 0) {
+        now_ms = 1;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&marks_ms[mark], &unset, now_ms, memory_order_relaxed,
+                                                 memory_order_relaxed)) {
+        return false;
+    }
+    if (elapsed_ms != NULL) {
+        *elapsed_ms = now_ms;
+    }
+    return true;
+}
+
+void metrics_sample_stack(metric_stack_t stack) {
+    // ESP-IDF reports the high-water mark in bytes
+    atomic_store_explicit(&stack_free[stack], uxTaskGetStackHighWaterMark(NULL), memory_order_relaxed);
+}
+
+void metrics_note_restart(metric_restart_cause_t cause) {
+    restart_cause = cause;
+    restart_magic = METRICS_RESTART_MAGIC;
+}
+
+void metrics_publish_sent(int msg_id) {
+    if (msg_id <= 0) {
+        return; // QoS 0 publishes are never acknowledged
+    }
+    taskENTER_CRITICAL(&pending_lock);
+    pending_acks[next_pending].msg_id = msg_id;
+    pending_acks[next_pending].sent_us = esp_timer_get_time();
+    next_pending = (next_pending + 1) % METRICS_PENDING_ACKS;
+    taskEXIT_CRITICAL(&pending_lock);
+}
+
+void metrics_on_disconnected(void) {
+    // msg_ids restart with the new session, so an old entry could only ever match the wrong publish
+    taskENTER_CRITICAL(&pending_lock);
+    memset(pending_acks, 0, sizeof(pending_acks));
+    taskEXIT_CRITICAL(&pending_lock);
+}
+
+// Runs on the MQTT event task alongside the gecl handlers
+static void metrics_published_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
+                                      void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+    int64_t sent_us = -1;
+
+    taskENTER_CRITICAL(&pending_lock);
+    for (size_t i = 0; i < METRICS_PENDING_ACKS; i++) {
+        if (pending_acks[i].msg_id == event->msg_id) {
+            sent_us = pending_acks[i].sent_us;
+            pending_acks[i].msg_id = 0;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&pending_lock);
+
+    // Anything older was resent or dropped from the outbox, so the time would not be a round trip
+    if (sent_us >= 0 && esp_timer_get_time() - sent_us <= METRICS_ACK_EXPIRY_US) {
+        metrics_count(METRIC_PUBLISH_ACKED);
+        metrics_observe(METRIC_HIST_PUBLISH_ACK_MS, (esp_timer_get_time() - sent_us) / 1000);
+    }
+}
+
+static const char *reset_reason_name(esp_reset_reason_t reason) {
+    switch (reason) {
+    case ESP_RST_POWERON:
+        return "poweron";
+    case ESP_RST_EXT:
+        return "external";
+    case ESP_RST_SW:
+        return "software";
+    case ESP_RST_PANIC:
+        return "panic";
+    case ESP_RST_INT_WDT:
+        return "int_wdt";
+    case ESP_RST_TASK_WDT:
+        return "task_wdt";
+    case ESP_RST_WDT:
+        return "wdt";
+    case ESP_RST_DEEPSLEEP:
+        return "deepsleep";
+    case ESP_RST_BROWNOUT:
+        return "brownout";
+    default:
+        return "other";
+    }
+}
+
+// snprintf onto the end of payload; len keeps counting past size so the caller sees the full length
+static void append(char *payload, size_t size, int *len, const char *format, ...) {
+    va_list args;
+    size_t used = *len < (int)size ? *len : size;
+
+    va_start(args, format);
+    *len += vsnprintf(payload + used, size - used, format, args);
+    va_end(args);
+}
+
+int metrics_format_report(char *payload, size_t size) {
+    mqtt_reconnect_stats_t reconnect;
+    supervisor_stats_t recovery;
+    int len = 0;
+
+    mqtt_reconnect_get_stats(&reconnect);
+    supervisor_get_stats(&recovery);
+
+    append(payload, size, &len,
+           "{\"hostname\":\"%s\",\"version\":\"%s\",\"uptime_s\":%lu,\"reset\":\"%s\",\"restart_cause\":\"%s\","
+           "\"config\":%lu,\"heap_free\":%lu,\"heap_min\":%lu,\"buffered\":%u,\"stack\":{",
+           provisioning_get()->location, esp_app_get_description()->version,
+           (unsigned long)(esp_timer_get_time() / 1000000), reset_reason_name(esp_reset_reason()),
+           restart_cause_names[last_restart_cause], (unsigned long)runtime_config_version(),
+           (unsigned long)esp_get_free_heap_size(),
+           (unsigned long)esp_get_minimum_free_heap_size(), (unsigned)reading_buffer_count());
+    for (size_t i = 0; i < METRIC_STACK_COUNT; i++) {
+        append(payload, size, &len, "%s\"%s\":%lu", i ? "," : "", stack_names[i],
+               (unsigned long)atomic_load_explicit(&stack_free[i], memory_order_relaxed));
+    }
+    append(payload, size, &len, "},\"counters\":{");
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        append(payload, size, &len, "%s\"%s\":%lu", i ? "," : "", counter_names[i],
+               (unsigned long)atomic_load_explicit(&counters[i], memory_order_relaxed));
+    }
+    append(payload, size, &len, "},\"boot_ms\":{");
+    for (size_t i = 0; i < METRIC_MARK_COUNT; i++) {
+        append(payload, size, &len, "%s\"%s\":%lu", i ? "," : "", mark_names[i],
+               (unsigned long)atomic_load_explicit(&marks_ms[i], memory_order_relaxed));
+    }
+    append(payload, size, &len, "},\"startup_ms\":{");
+    for (size_t i = 0; i < STARTUP_STAGE_COUNT; i++) {
+        append(payload, size, &len, "%s\"%s\":%lu", i ? "," : "", startup_stage_name(i),
+               (unsigned long)startup_stage_ms(i));
+    }
+    append(payload, size, &len, "},\"mqtt\":{\"disconnects\":%lu,\"attempts\":%lu,\"longest_outage_ms\":%lu}",
+           (unsigned long)reconnect.disconnects, (unsigned long)reconnect.attempts,
+           (unsigned long)reconnect.longest_outage_ms);
+    append(payload, size, &len, ",\"recovery\":{\"incidents\":%lu,\"open\":%s", (unsigned long)recovery.incidents,
+           recovery.open ? "true" : "false");
+    for (size_t i = 0; i < SUPERVISOR_STEP_COUNT; i++) {
+        append(payload, size, &len, ",\"%s\":%lu", supervisor_step_name(i), (unsigned long)recovery.recovered[i]);
+    }
+    append(payload, size, &len, "}");
+    for (size_t i = 0; i < METRIC_HIST_COUNT; i++) {
+        histogram_t *h = &histograms[i];
+
+        append(payload, size, &len, ",\"%s\":{\"n\":%lu,\"sum\":%lu,\"max\":%lu,\"b\":[", histogram_names[i],
+               (unsigned long)atomic_load_explicit(&h->count, memory_order_relaxed),
+               (unsigned long)atomic_load_explicit(&h->sum_ms, memory_order_relaxed),
+               (unsigned long)atomic_load_explicit(&h->max_ms, memory_order_relaxed));
+        for (size_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            append(payload, size, &len, "%s%lu", b ? "," : "",
+                   (unsigned long)atomic_load_explicit(&h->buckets[b], memory_order_relaxed));
+        }
+        append(payload, size, &len, "]}");
+    }
+    append(payload, size, &len, "}");
+    return len;
+}
+
+#if CONFIG_METRICS_REPORT_INTERVAL_S > 0
+static void metrics_task(void *pvParameter) {
+    static char payload[METRICS_REPORT_MAX];
+    TickType_t delay = pdMS_TO_TICKS(METRICS_FIRST_REPORT_S * 1000);
+
+    while (1) {
+        vTaskDelay(delay);
+        // A day in milliseconds overflows the 32-bit multiply in pdMS_TO_TICKS
+        delay = (TickType_t)((uint64_t)CONFIG_METRICS_REPORT_INTERVAL_S * configTICK_RATE_HZ);
+
+        metrics_sample_stack(METRIC_STACK_METRICS);
+        int len = metrics_format_report(payload, sizeof(payload));
+        if (len >= (int)sizeof(payload)) {
+            ESP_LOGE(TAG, "Report needs %d bytes, buffer is %u", len, (unsigned)sizeof(payload));
+            continue;
+        }
+        if (esp_mqtt_client_publish(metrics_client, CONFIG_PUBLISH_METRICS_TOPIC, payload, len, 0, 0) == -1) {
+            ESP_LOGW(TAG, "Metrics report not published, MQTT not connected");
+        } else {
+            ESP_LOGI(TAG, "%s", payload);
+        }
+    }
+}
+#endif
+
+esp_err_t metrics_start(esp_mqtt_client_handle_t client) {
+    if (restart_magic == METRICS_RESTART_MAGIC && restart_cause <= METRIC_RESTART_OTA) {
+        last_restart_cause = restart_cause;
+    }
+    restart_magic = 0;
+    ESP_LOGI(TAG, "Reset reason %s, restart cause %s", reset_reason_name(esp_reset_reason()),
+             restart_cause_names[last_restart_cause]);
+
+    metrics_client = client;
+    esp_err_t err = esp_mqtt_client_register_event(client, MQTT_EVENT_PUBLISHED, metrics_published_handler, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Publish acknowledgements will not be timed: %s", esp_err_to_name(err));
+    }
+
+#if CONFIG_METRICS_REPORT_INTERVAL_S > 0
+    if (xTaskCreate(&metrics_task, "metrics_task", 3072, NULL, 2, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#define METRICS_REPORT_MAX 1280 // Largest report metrics_format_report produces, with room to spare
+
+typedef enum {
+    METRIC_READINGS,            // Bursts that produced a reading
+    METRIC_READINGS_SUPPRESSED, // Readings inside the publish deadband
+    METRIC_RANGING_FAILURES,    // Bursts rejected by the filter
+    METRIC_PUBLISH_OK,          // Telemetry publishes accepted by the client
+    METRIC_PUBLISH_FAILED,      // Telemetry publishes refused, readings kept for retry
+    METRIC_PUBLISH_ACKED,       // PUBACKs matched to a tracked publish
+    METRIC_MESSAGES_IN,         // MQTT_EVENT_DATA seen
+    METRIC_MESSAGES_UNROUTED,   // Messages no route claimed
+    METRIC_OTA_STARTED,
+    METRIC_LEVEL_EVENTS,        // Drink, refill and evaporation events published
+    METRIC_FAULTS,              // Faults reported to the supervisor
+    METRIC_COUNTER_COUNT,
+} metric_counter_t;
+
+// Stack high-water marks, in bytes of stack that were never touched
+typedef enum {
+    METRIC_STACK_ULTRASONIC,
+    METRIC_STACK_OTA,
+    METRIC_STACK_MQTT,
+    METRIC_STACK_METRICS,
+    METRIC_STACK_COUNT,
+} metric_stack_t;
+
+// Fixed-bucket latency histograms, in milliseconds. Bucket upper bounds are
+// 25, 50, 100, 250, 500, 1000, 2500 and 5000 ms, plus one for anything slower.
+typedef enum {
+    METRIC_HIST_RANGING_MS,     // One full burst, gaps included
+    METRIC_HIST_PUBLISH_ACK_MS, // QoS 1 publish to PUBACK
+    METRIC_HIST_WIFI_RECONNECT_MS, // Station disconnect to IP address
+    METRIC_HIST_MQTT_RECONNECT_MS, // MQTT disconnect to MQTT_EVENT_CONNECTED
+    METRIC_HIST_RECOVERY_MS,       // Fault reported to the supervisor seeing it cleared
+    METRIC_HIST_COUNT,
+} metric_histogram_t;
+
+// Milestones in milliseconds since boot (or since the deep-sleep wake); only the first occurrence counts
+typedef enum {
+    METRIC_MARK_WIFI_UP,
+    METRIC_MARK_MQTT_CONNECTED,
+    METRIC_MARK_FIRST_PUBLISH,
+    METRIC_MARK_COUNT,
+} metric_mark_t;
+
+// Why the firmware last restarted itself; kept across the restart so the next boot can report it
+typedef enum {
+    METRIC_RESTART_NONE,
+    METRIC_RESTART_ORPHAN_TIMER,
+    METRIC_RESTART_MQTT_ERROR,
+    METRIC_RESTART_MQTT_GIVE_UP,
+    METRIC_RESTART_BAD_MESSAGE,
+    METRIC_RESTART_INTERNAL, // A timer or task could not be created or reset
+    METRIC_RESTART_OTA,
+} metric_restart_cause_t;
+
+// Increments are atomic and safe from any task
+void metrics_count(metric_counter_t counter);
+void metrics_observe(metric_histogram_t histogram, uint32_t value_ms);
+
+// Returns true, with the elapsed time in elapsed_ms if not NULL, the first time a mark is reached
+bool metrics_mark(metric_mark_t mark, uint32_t *elapsed_ms);
+
+// Record the calling task's stack high-water mark
+void metrics_sample_stack(metric_stack_t stack);
+
+// Call just before a deliberate restart
+void metrics_note_restart(metric_restart_cause_t cause);
+
+// Match PUBACKs to publishes to time them. msg_id is what esp_mqtt_client_publish returned.
+void metrics_publish_sent(int msg_id);
+
+// Forget publishes still waiting for a PUBACK; call on MQTT_EVENT_DISCONNECTED
+void metrics_on_disconnected(void);
+
+/*
+ * Pick up the previous restart cause, hook MQTT_EVENT_PUBLISHED on client and start the task that publishes
+ * one compact report on CONFIG_PUBLISH_METRICS_TOPIC every CONFIG_METRICS_REPORT_INTERVAL_S.
+ */
+esp_err_t metrics_start(esp_mqtt_client_handle_t client);
+
+// Format the current report; returns the length snprintf would
+int metrics_format_report(char *payload, size_t size);
@@ -0,0 +1,158 @@
+#include "mqtt_reconnect.h"
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "gecl-wifi-manager.h"
+
+#include "metrics.h"
+#include "supervisor.h"
+
+static const char *TAG = "MQTT_RECONNECT";
+
+typedef enum {
+    RECONNECT_STATE_CONNECTED,
+    RECONNECT_STATE_BACKOFF,
+} reconnect_state_t;
+
+static esp_timer_handle_t backoff_timer = NULL;
+static esp_mqtt_client_handle_t reconnect_client = NULL;
+static portMUX_TYPE reconnect_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static reconnect_state_t state = RECONNECT_STATE_CONNECTED;
+static uint32_t backoff_step = 0;
+static int64_t outage_start_us = 0;
+static bool gave_up = false; // This outage has been handed to the supervisor
+static mqtt_reconnect_stats_t stats;
+
+// Exponential backoff with equal jitter: half the window is fixed, half is random
+static uint32_t next_delay_ms(void) {
+    uint32_t delay = CONFIG_MQTT_RECONNECT_MAX_MS;
+
+    if (backoff_step < 31 && ((uint32_t)CONFIG_MQTT_RECONNECT_BASE_MS << backoff_step) < delay) {
+        delay = CONFIG_MQTT_RECONNECT_BASE_MS << backoff_step;
+        backoff_step++;
+    }
+    return delay / 2 + esp_random() % (delay / 2 + 1);
+}
+
+static void schedule_attempt(void) {
+    uint32_t delay_ms = next_delay_ms();
+
+    esp_timer_stop(backoff_timer);
+    esp_err_t err = esp_timer_start_once(backoff_timer, (uint64_t)delay_ms * 1000);
+    if (err != ESP_OK) {
+        // Without the timer nothing retries; let the supervisor take it from here
+        ESP_LOGE(TAG, "Failed to schedule MQTT reconnect: %s", esp_err_to_name(err));
+        supervisor_report(SUPERVISOR_FAULT_INTERNAL);
+        return;
+    }
+    ESP_LOGI(TAG, "Next MQTT reconnect attempt in %lu ms", (unsigned long)delay_ms);
+}
+
+// Runs on the esp_timer task, never on the MQTT event task
+static void backoff_timer_callback(void *arg) {
+    int64_t outage_ms = (esp_timer_get_time() - outage_start_us) / 1000;
+
+    if (state != RECONNECT_STATE_BACKOFF) {
+        return;
+    }
+
+#if CONFIG_MQTT_RECONNECT_GIVE_UP_MIN > 0
+    // Escalate only once reconnecting has demonstrably stopped working; attempts carry on while the supervisor acts
+    if (!gave_up && outage_ms >= (int64_t)CONFIG_MQTT_RECONNECT_GIVE_UP_MIN * 60 * 1000) {
+        ESP_LOGE(TAG, "MQTT unreachable for %lld s after %lu attempts. Escalating", (long long)(outage_ms / 1000),
+                 (unsigned long)stats.attempts);
+        gave_up = true;
+        supervisor_report(SUPERVISOR_FAULT_MQTT_GIVE_UP);
+    }
+#endif
+
+    if (!wifi_active()) {
+        // The Wi-Fi manager reconnects on its own; retry MQTT once the network is back
+        stats.skipped_no_wifi++;
+        ESP_LOGW(TAG, "Network not connected, deferring MQTT reconnection");
+    } else {
+        stats.attempts++;
+        ESP_LOGI(TAG, "Attempting MQTT reconnect (outage %lld s)", (long long)(outage_ms / 1000));
+        esp_err_t err = esp_mqtt_client_reconnect(reconnect_client);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to reconnect MQTT client: %s", esp_err_to_name(err));
+        }
+    }
+
+    // Keep backing off until MQTT_EVENT_CONNECTED cancels the timer
+    schedule_attempt();
+}
+
+esp_err_t mqtt_reconnect_init(void) {
+    const esp_timer_create_args_t args = {
+        .callback = backoff_timer_callback,
+        .name = "mqtt_reconnect",
+    };
+
+    if (backoff_timer != NULL) {
+        return ESP_OK;
+    }
+    return esp_timer_create(&args, &backoff_timer);
+}
+
+void mqtt_reconnect_on_disconnected(esp_mqtt_client_handle_t client) {
+    bool new_outage = false;
+
+    taskENTER_CRITICAL(&reconnect_lock);
+    reconnect_client = client;
+    if (state == RECONNECT_STATE_CONNECTED) {
+        state = RECONNECT_STATE_BACKOFF;
+        backoff_step = 0;
+        outage_start_us = esp_timer_get_time();
+        stats.disconnects++;
+        new_outage = true;
+    }
+    taskEXIT_CRITICAL(&reconnect_lock);
+
+    // A failed attempt also reports a disconnect; the timer is already running then
+    if (new_outage && backoff_timer != NULL) {
+        schedule_attempt();
+    }
+}
+
+void mqtt_reconnect_on_connected(void) {
+    bool reconnected = false;
+
+    if (backoff_timer != NULL) {
+        esp_timer_stop(backoff_timer);
+    }
+
+    taskENTER_CRITICAL(&reconnect_lock);
+    if (state == RECONNECT_STATE_BACKOFF && outage_start_us != 0) {
+        uint32_t outage_ms = (esp_timer_get_time() - outage_start_us) / 1000;
+        stats.last_outage_ms = outage_ms;
+        stats.total_outage_ms += outage_ms;
+        if (outage_ms > stats.longest_outage_ms) {
+            stats.longest_outage_ms = outage_ms;
+        }
+        reconnected = true;
+    }
+    state = RECONNECT_STATE_CONNECTED;
+    backoff_step = 0;
+    gave_up = false;
+    taskEXIT_CRITICAL(&reconnect_lock);
+
+    if (reconnected) {
+        metrics_observe(METRIC_HIST_MQTT_RECONNECT_MS, stats.last_outage_ms);
+    }
+    if (stats.disconnects > 0) {
+        ESP_LOGI(TAG, "MQTT reconnected after %lu ms (%lu attempts, %lu disconnects so far)",
+                 (unsigned long)stats.last_outage_ms, (unsigned long)stats.attempts, (unsigned long)stats.disconnects);
+    }
+}
+
+void mqtt_reconnect_get_stats(mqtt_reconnect_stats_t *out) {
+    taskENTER_CRITICAL(&reconnect_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&reconnect_lock);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+typedef struct {
+    uint32_t disconnects;       // MQTT_EVENT_DISCONNECTED seen while connected
+    uint32_t attempts;          // esp_mqtt_client_reconnect calls issued
+    uint32_t skipped_no_wifi;   // Attempts deferred because Wi-Fi was down
+    uint32_t last_outage_ms;    // Duration of the most recent completed outage
+    uint32_t longest_outage_ms;
+    uint64_t total_outage_ms;
+} mqtt_reconnect_stats_t;
+
+// Create the backoff timer. Call before the MQTT client is started.
+esp_err_t mqtt_reconnect_init(void);
+
+// Start (or continue) backing off. Never blocks; safe to call from the MQTT event task.
+void mqtt_reconnect_on_disconnected(esp_mqtt_client_handle_t client);
+
+// Stop backing off and close out the outage
+void mqtt_reconnect_on_connected(void);
+
+void mqtt_reconnect_get_stats(mqtt_reconnect_stats_t *stats);
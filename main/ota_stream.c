@@ -0,0 +1,275 @@
+#include "ota_stream.h"
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "json_scan.h"
+#include "metrics.h"
+#include "provisioning.h"
+
+#define OTA_STREAM_BUFFER_SIZE 1024
+#define OTA_STREAM_TIMEOUT_MS 15000
+#define OTA_STREAM_RETRY_DELAY_MS 5000
+#define OTA_STREAM_PROGRESS_STEP 5 // Percent between progress reports
+
+static const char *TAG = "OTA_STREAM";
+
+// Owned by the OTA task for the whole update, so the caller's copy can go away
+static ota_stream_request_t active_request;
+static TaskHandle_t ota_stream_task_handle = NULL;
+static char buffer[OTA_STREAM_BUFFER_SIZE];
+
+typedef struct {
+    esp_ota_handle_t handle;
+    const esp_partition_t *partition;
+    mbedtls_sha256_context sha;
+    uint32_t offset; // Bytes written and hashed so far
+    uint32_t total;  // 0 until known
+    int last_percent;
+    bool image_open; // handle is live and must be ended or aborted
+} ota_progress_t;
+
+static void publish_progress(const ota_progress_t *progress, const char *state) {
+    char payload[160];
+    int percent = progress->total ? (int)((uint64_t)progress->offset * 100 / progress->total) : -1;
+
+    snprintf(payload, sizeof(payload),
+             "{\"hostname\": \"%s\", \"state\": \"%s\", \"percent\": %d, \"offset\": %lu, \"size\": %lu}",
+             provisioning_get()->location, state, percent, (unsigned long)progress->offset,
+             (unsigned long)progress->total);
+    // QoS 0: a lost progress report is not worth a retransmit, and this never blocks on the broker
+    esp_mqtt_client_publish(active_request.mqtt_client, CONFIG_PUBLISH_OTA_PROGRESS_TOPIC, payload, 0, 0, 0);
+    ESP_LOGI(TAG, "%s", payload);
+    metrics_sample_stack(METRIC_STACK_OTA);
+}
+
+static esp_err_t begin_image(ota_progress_t *progress) {
+    progress->offset = 0;
+    progress->last_percent = -1;
+    mbedtls_sha256_init(&progress->sha);
+    mbedtls_sha256_starts(&progress->sha, 0);
+    esp_err_t err = esp_ota_begin(progress->partition, OTA_WITH_SEQUENTIAL_WRITES, &progress->handle);
+    progress->image_open = err == ESP_OK;
+    return err;
+}
+
+// Stream one HTTP response into the slot. Returns ESP_OK once the whole image has been written.
+static esp_err_t download_from_offset(ota_progress_t *progress) {
+    esp_http_client_config_t config = {
+        .url = active_request.url,
+        .timeout_ms = OTA_STREAM_TIMEOUT_MS,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .keep_alive_enable = true,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_err_t err;
+
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (progress->offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)progress->offset);
+        esp_http_client_set_header(client, "Range", range);
+    }
+
+    err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        goto cleanup;
+    }
+
+    int64_t content_length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    if (progress->offset > 0 && status == 200) {
+        // Server ignored the range; the hash and slot must start over with the full body
+        ESP_LOGW(TAG, "Server does not support range requests, restarting from zero");
+        esp_ota_abort(progress->handle);
+        progress->image_open = false;
+        mbedtls_sha256_free(&progress->sha);
+        err = begin_image(progress);
+        if (err != ESP_OK) {
+            goto cleanup;
+        }
+    } else if (status != 200 && status != 206) {
+        ESP_LOGE(TAG, "Unexpected HTTP status %d", status);
+        err = ESP_FAIL;
+        goto cleanup;
+    }
+
+    if (progress->total == 0 && content_length > 0) {
+        progress->total = progress->offset + (uint32_t)content_length;
+    }
+
+    while (true) {
+        int read = esp_http_client_read(client, buffer, sizeof(buffer));
+        if (read < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (read == 0) {
+            err = esp_http_client_is_complete_data_received(client) ? ESP_OK : ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        err = esp_ota_write(progress->handle, buffer, read);
+        if (err != ESP_OK) {
+            break;
+        }
+        mbedtls_sha256_update(&progress->sha, (const unsigned char *)buffer, read);
+        progress->offset += read;
+
+        int percent = progress->total ? (int)((uint64_t)progress->offset * 100 / progress->total) : 0;
+        if (percent / OTA_STREAM_PROGRESS_STEP != progress->last_percent / OTA_STREAM_PROGRESS_STEP) {
+            progress->last_percent = percent;
+            publish_progress(progress, "downloading");
+        }
+    }
+
+cleanup:
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+static bool sha256_matches(ota_progress_t *progress) {
+    unsigned char digest[32];
+    char hex[OTA_STREAM_SHA256_HEX_LEN + 1];
+
+    mbedtls_sha256_finish(&progress->sha, digest);
+    if (active_request.sha256[0] == '\0') {
+        return true; // esp_ota_end still checks the digest embedded in the image
+    }
+    for (size_t i = 0; i < sizeof(digest); i++) {
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    return strncasecmp(hex, active_request.sha256, OTA_STREAM_SHA256_HEX_LEN) == 0;
+}
+
+static void ota_stream_task(void *pvParameter) {
+    ota_progress_t progress = {.total = active_request.size};
+    int attempts = 0;
+    esp_err_t err;
+
+    progress.partition = esp_ota_get_next_update_partition(NULL);
+    if (progress.partition == NULL) {
+        ESP_LOGE(TAG, "No inactive OTA slot");
+        goto fail_no_image;
+    }
+    ESP_LOGI(TAG, "Streaming %s into %s", active_request.url, progress.partition->label);
+
+    err = begin_image(&progress);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        goto fail_no_image;
+    }
+
+    // Resume from the last written byte after a dropped connection rather than starting over
+    while ((err = download_from_offset(&progress)) != ESP_OK) {
+        if (!progress.image_open) {
+            ESP_LOGE(TAG, "esp_ota_begin failed restarting from zero: %s", esp_err_to_name(err));
+            goto fail_no_image;
+        }
+        if (++attempts >= CONFIG_OTA_STREAM_MAX_RETRIES) {
+            ESP_LOGE(TAG, "Giving up after %d attempts at offset %lu", attempts, (unsigned long)progress.offset);
+            goto fail;
+        }
+        ESP_LOGW(TAG, "Download interrupted at %lu bytes (%s), resuming in %d ms", (unsigned long)progress.offset,
+                 esp_err_to_name(err), OTA_STREAM_RETRY_DELAY_MS);
+        vTaskDelay(pdMS_TO_TICKS(OTA_STREAM_RETRY_DELAY_MS));
+    }
+
+    if (active_request.size && progress.offset != active_request.size) {
+        ESP_LOGE(TAG, "Image is %lu bytes, expected %lu", (unsigned long)progress.offset,
+                 (unsigned long)active_request.size);
+        goto fail;
+    }
+    if (!sha256_matches(&progress)) {
+        ESP_LOGE(TAG, "SHA-256 mismatch, discarding image");
+        goto fail; // Frees the hash context there, once
+    }
+    mbedtls_sha256_free(&progress.sha);
+
+    err = esp_ota_end(progress.handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(progress.partition);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to activate image: %s", esp_err_to_name(err));
+        publish_progress(&progress, "failed");
+        goto done;
+    }
+
+    publish_progress(&progress, "complete");
+    ESP_LOGI(TAG, "OTA complete, restarting into %s", progress.partition->label);
+    vTaskDelay(pdMS_TO_TICKS(1000)); // Let the final report go out
+    metrics_note_restart(METRIC_RESTART_OTA);
+    esp_restart();
+
+fail:
+    esp_ota_abort(progress.handle);
+fail_no_image:
+    mbedtls_sha256_free(&progress.sha);
+    publish_progress(&progress, "failed");
+done:
+    ota_stream_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+bool ota_stream_parse_manifest(const char *data, size_t len, ota_stream_request_t *request, char *version,
+                               size_t version_size) {
+    json_span_t value;
+
+    if (!json_scan_find(data, len, "url", &value) || !json_span_to_string(&value, request->url, sizeof(request->url))) {
+        ESP_LOGW(TAG, "Manifest has no usable url");
+        return false;
+    }
+
+    request->size = 0;
+    if (json_scan_find(data, len, "size", &value) && !json_span_to_uint32(&value, &request->size)) {
+        ESP_LOGW(TAG, "Manifest size is not an unsigned integer");
+        return false;
+    }
+
+    request->sha256[0] = '\0';
+    if (json_scan_find(data, len, "sha256", &value) &&
+        (!json_span_to_string(&value, request->sha256, sizeof(request->sha256)) ||
+         strlen(request->sha256) != OTA_STREAM_SHA256_HEX_LEN)) {
+        ESP_LOGW(TAG, "Manifest sha256 is not a 64 character hex digest");
+        return false;
+    }
+
+    version[0] = '\0';
+    if (json_scan_find(data, len, "version", &value) && !json_span_to_string(&value, version, version_size)) {
+        ESP_LOGW(TAG, "Manifest version is too long");
+        return false;
+    }
+    return true;
+}
+
+esp_err_t ota_stream_start(const ota_stream_request_t *request) {
+    if (ota_stream_task_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    active_request = *request;
+    if (xTaskCreate(&ota_stream_task, "ota_task", 8192, NULL, 4, &ota_stream_task_handle) != pdPASS) {
+        ota_stream_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool ota_stream_in_progress(void) {
+    return ota_stream_task_handle != NULL;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#define OTA_STREAM_URL_MAX 256
+#define OTA_STREAM_SHA256_HEX_LEN 64
+
+typedef struct {
+    esp_mqtt_client_handle_t mqtt_client; // Used for progress reports
+    char url[OTA_STREAM_URL_MAX];
+    char sha256[OTA_STREAM_SHA256_HEX_LEN + 1]; // Expected image hash in hex, empty to skip the check
+    uint32_t size;                              // Expected image size, 0 if unknown
+} ota_stream_request_t;
+
+/*
+ * Parse a targeted OTA manifest into request (the MQTT client is left untouched):
+ *
+ *   {"url": "https://...", "size": 1234567, "sha256": "<64 hex>", "version": "v1.0.0-abc1234"}
+ *
+ * Only url is required. version is copied out (empty if absent) so the caller can skip images it already runs.
+ */
+bool ota_stream_parse_manifest(const char *data, size_t len, ota_stream_request_t *request, char *version,
+                               size_t version_size);
+
+// Copy the request and start downloading into the inactive OTA slot. Fails if an update is already running.
+esp_err_t ota_stream_start(const ota_stream_request_t *request);
+
+bool ota_stream_in_progress(void);
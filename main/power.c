@@ -0,0 +1,107 @@
+#include "power.h"
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LOW_POWER_CONNECTED
+#include "esp_pm.h"
+#include "esp_wifi.h"
+#endif
+
+static const char *TAG = "POWER";
+
+#if CONFIG_LOW_POWER_CONNECTED
+#define POWER_MIN_FREQ_MHZ 40 // XTAL frequency; the lowest the C3 runs Wi-Fi at
+
+static esp_pm_lock_handle_t busy_lock = NULL;
+
+esp_err_t power_init(void) {
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_OK) {
+        err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "busy", &busy_lock);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable automatic light sleep: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Tickless idle with automatic light sleep, %d-%d MHz", POWER_MIN_FREQ_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    return ESP_OK;
+}
+
+esp_err_t power_tune_wifi(void) {
+    wifi_config_t config;
+
+    esp_err_t err = esp_wifi_get_config(WIFI_IF_STA, &config);
+    if (err == ESP_OK) {
+        // Only read at association, so this applies from the next (re)connect
+        config.sta.listen_interval = CONFIG_LOW_POWER_LISTEN_INTERVAL;
+        err = esp_wifi_set_config(WIFI_IF_STA, &config);
+    }
+    if (err == ESP_OK) {
+        err = esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to enable modem sleep: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Modem sleep, waking every %d beacons", CONFIG_LOW_POWER_LISTEN_INTERVAL);
+    return ESP_OK;
+}
+
+esp_err_t power_tune_mqtt(esp_mqtt_client_handle_t client, const mqtt_config_t *mqtt) {
+    // esp_mqtt_set_config does not merge, so restate the broker and TLS settings init_mqtt applied
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = mqtt->broker_uri,
+        .broker.verification.certificate = (const char *)mqtt->root_ca,
+        .credentials.authentication.certificate = (const char *)mqtt->certificate,
+        .credentials.authentication.key = (const char *)mqtt->private_key,
+        .session.keepalive = CONFIG_LOW_POWER_MQTT_KEEPALIVE_S,
+    };
+
+    esp_err_t err = esp_mqtt_set_config(client, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set MQTT keepalive: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "MQTT keepalive %d s", CONFIG_LOW_POWER_MQTT_KEEPALIVE_S);
+    return ESP_OK;
+}
+
+void power_busy_begin(void) {
+    if (busy_lock != NULL) {
+        esp_pm_lock_acquire(busy_lock);
+    }
+}
+
+void power_busy_end(void) {
+    if (busy_lock != NULL) {
+        esp_pm_lock_release(busy_lock);
+    }
+}
+#else
+esp_err_t power_init(void) {
+    ESP_LOGD(TAG, "Low-power mode disabled");
+    return ESP_OK;
+}
+
+esp_err_t power_tune_wifi(void) {
+    return ESP_OK;
+}
+
+esp_err_t power_tune_mqtt(esp_mqtt_client_handle_t client, const mqtt_config_t *mqtt) {
+    return ESP_OK;
+}
+
+void power_busy_begin(void) {
+}
+
+void power_busy_end(void) {
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "esp_err.h"
+#include "gecl-mqtt-manager.h"
+#include "mqtt_client.h"
+
+/*
+ * Always-connected low-power mode (CONFIG_LOW_POWER_CONNECTED). Between events the CPU idles tickless and drops
+ * into automatic light sleep, and the radio sits in modem sleep, waking every listen interval for the AP's DTIM
+ * beacon. Everything here is a no-op when the mode is off.
+ */
+
+// Configure dynamic frequency scaling and automatic light sleep. Call once, early in app_main.
+esp_err_t power_init(void);
+
+// Enable max modem sleep with the configured listen interval. Call after init_wifi.
+esp_err_t power_tune_wifi(void);
+
+/*
+ * Stretch the MQTT keepalive so idle pings are rare. Takes full effect from the next (re)connect. mqtt is the
+ * config client was created from; the broker and TLS settings are applied again along with the keepalive.
+ */
+esp_err_t power_tune_mqtt(esp_mqtt_client_handle_t client, const mqtt_config_t *mqtt);
+
+/*
+ * Hold off light sleep while timing-critical work runs, e.g. a ranging burst whose echo edges are timestamped
+ * by an ISR. Calls nest.
+ */
+void power_busy_begin(void);
+void power_busy_end(void);
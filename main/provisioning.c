@@ -0,0 +1,116 @@
+#include "provisioning.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+static const char *TAG = "PROVISIONING";
+
+static provisioning_t provisioning = {
+    .location = CONFIG_LOCATION,
+    .hostname = CONFIG_WIFI_HOSTNAME,
+    .broker_uri = CONFIG_IOT_ENDPOINT,
+    .level_topic = CONFIG_PUBLISH_WATER_LEVEL_TOPIC,
+    .led_topic = CONFIG_SUBSCRIBE_LED_COLOR_TOPIC,
+    .ota_topic = CONFIG_SUBSCRIBE_OTA_UPDATE_TOPIC,
+    .ota_group = CONFIG_OTA_GROUP,
+    .config_topic = CONFIG_SUBSCRIBE_CONFIG_TOPIC,
+};
+
+// Keep the default unless the key is present; a value too long for its field is an error, not a truncation
+static esp_err_t read_optional(nvs_handle_t handle, const char *key, char *value, size_t size) {
+    esp_err_t err = nvs_get_str(handle, key, value, &size);
+
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Bad '%s': %s", key, esp_err_to_name(err));
+    }
+    return err;
+}
+
+// PEM blobs are sized at runtime and kept for the life of the firmware
+static esp_err_t read_pem(nvs_handle_t handle, const char *key, const char **value) {
+    size_t length = 0;
+
+    esp_err_t err = nvs_get_str(handle, key, NULL, &length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Missing '%s': %s", key, esp_err_to_name(err));
+        return err;
+    }
+    char *pem = malloc(length);
+    if (pem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_str(handle, key, pem, &length);
+    if (err != ESP_OK) {
+        free(pem);
+        return err;
+    }
+    *value = pem;
+    return ESP_OK;
+}
+
+static esp_err_t open_store(nvs_handle_t *handle) {
+    esp_err_t err = nvs_flash_init_partition(PROVISIONING_PARTITION);
+
+    if (err == ESP_OK) {
+        return nvs_open_from_partition(PROVISIONING_PARTITION, PROVISIONING_NAMESPACE, NVS_READONLY, handle);
+    }
+    // Partition tables from before the prov partition: look in the default one
+    ESP_LOGW(TAG, "No '%s' partition (%s), trying the default NVS partition", PROVISIONING_PARTITION,
+             esp_err_to_name(err));
+    return nvs_open(PROVISIONING_NAMESPACE, NVS_READONLY, handle);
+}
+
+esp_err_t provisioning_load(void) {
+    nvs_handle_t handle;
+
+    esp_err_t err = open_store(&handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Bowl is not provisioned: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const struct {
+        const char *key;
+        char *value;
+        size_t size;
+    } fields[] = {
+        {"location", provisioning.location, sizeof(provisioning.location)},
+        {"hostname", provisioning.hostname, sizeof(provisioning.hostname)},
+        {"endpoint", provisioning.broker_uri, sizeof(provisioning.broker_uri)},
+        {"level_topic", provisioning.level_topic, sizeof(provisioning.level_topic)},
+        {"led_topic", provisioning.led_topic, sizeof(provisioning.led_topic)},
+        {"ota_topic", provisioning.ota_topic, sizeof(provisioning.ota_topic)},
+        {"ota_group", provisioning.ota_group, sizeof(provisioning.ota_group)},
+        {"config_topic", provisioning.config_topic, sizeof(provisioning.config_topic)},
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]) && err == ESP_OK; i++) {
+        err = read_optional(handle, fields[i].key, fields[i].value, fields[i].size);
+    }
+    if (err == ESP_OK) {
+        err = read_pem(handle, "cert", &provisioning.certificate);
+    }
+    if (err == ESP_OK) {
+        err = read_pem(handle, "key", &provisioning.private_key);
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Bowl is not provisioned: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Provisioned as %s (%s), broker %s", provisioning.location, provisioning.hostname,
+             provisioning.broker_uri);
+    return ESP_OK;
+}
+
+const provisioning_t *provisioning_get(void) {
+    return &provisioning;
+}
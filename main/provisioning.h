@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+
+#define PROVISIONING_PARTITION "prov"
+#define PROVISIONING_NAMESPACE "prov"
+
+/*
+ * Per-device identity, loaded at boot so one firmware image serves the whole fleet. It is read from the "prov"
+ * namespace of the "prov" NVS partition, written once per bowl by scripts/provision/provision_bowl.sh, or of the
+ * default NVS partition on bowls whose partition table predates it.
+ *
+ * The certificate and private key are required. Every other key falls back to its Kconfig value, so fleet-wide
+ * settings need not be repeated per device.
+ */
+typedef struct {
+    char location[32];       // "location"; identifies the bowl in payloads
+    char hostname[32];       // "hostname"; provision_bowl.sh makes it unique per bowl
+    char broker_uri[128];    // "endpoint"
+    char level_topic[96];    // "level_topic"
+    char led_topic[96];      // "led_topic"
+    char ota_topic[96];      // "ota_topic"
+    char ota_group[32];      // "ota_group"; empty for none
+    char config_topic[96];   // "config_topic"
+    const char *certificate; // "cert", PEM
+    const char *private_key; // "key", PEM
+} provisioning_t;
+
+// Read the provisioning data. On failure the defaults are still filled in, but there are no credentials.
+esp_err_t provisioning_load(void);
+
+const provisioning_t *provisioning_get(void);
@@ -0,0 +1,166 @@
+#include "ranging.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <math.h>
+#include <string.h>
+
+#include "gecl-ultrasonic-manager.h"
+
+#include "echo_capture.h"
+#include "power.h"
+
+// Samples further than this many MADs from the median are treated as splashes
+#define RANGING_OUTLIER_MAD_FACTOR 3.0f
+
+static const char *TAG = "RANGING";
+
+static void sort_floats(float *values, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        float v = values[i];
+        size_t j = i;
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+// Expects sorted input
+static float median_of(const float *sorted, size_t count) {
+    if (count % 2) {
+        return sorted[count / 2];
+    }
+    return (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0f;
+}
+
+static bool in_range(float distance) {
+    return isfinite(distance) && distance >= CONFIG_RANGING_MIN_DISTANCE_CM &&
+           distance <= CONFIG_RANGING_MAX_DISTANCE_CM;
+}
+
+bool ranging_filter(const float *samples, size_t count, ranging_result_t *result) {
+    float valid[RANGING_MAX_BURST];
+    float deviation[RANGING_MAX_BURST];
+    size_t n = 0;
+
+    if (count > RANGING_MAX_BURST) {
+        count = RANGING_MAX_BURST;
+    }
+    memset(result, 0, sizeof(*result));
+    result->attempted = count;
+
+    // Drop timeouts and echoes outside the sensor's usable window
+    for (size_t i = 0; i < count; i++) {
+        if (in_range(samples[i])) {
+            valid[n++] = samples[i];
+        }
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    sort_floats(valid, n);
+    float median = median_of(valid, n);
+
+    for (size_t i = 0; i < n; i++) {
+        deviation[i] = fabsf(valid[i] - median);
+    }
+    sort_floats(deviation, n);
+    float mad = median_of(deviation, n);
+
+    // Reject ripples and splashes; the floor keeps a perfectly still surface from rejecting everything
+    float limit = RANGING_OUTLIER_MAD_FACTOR * mad;
+    float floor_cm = CONFIG_RANGING_OUTLIER_FLOOR_MM / 10.0f;
+    if (limit < floor_cm) {
+        limit = floor_cm;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (fabsf(valid[i] - median) <= limit) {
+            valid[kept++] = valid[i]; // Stays sorted
+        }
+    }
+
+    result->accepted = kept;
+    result->spread_cm = mad;
+
+    size_t min_valid = CONFIG_RANGING_MIN_VALID_SAMPLES;
+    if (min_valid > count) {
+        min_valid = count;
+    }
+    if (kept == 0 || kept < min_valid) {
+        return false;
+    }
+
+#if CONFIG_RANGING_FILTER_TRIMMED_MEAN
+    size_t trim = kept * CONFIG_RANGING_TRIM_PERCENT / 100;
+    float sum = 0.0f;
+    for (size_t i = trim; i < kept - trim; i++) {
+        sum += valid[i];
+    }
+    result->distance_cm = sum / (kept - 2 * trim);
+#else
+    result->distance_cm = median_of(valid, kept);
+#endif
+
+    float confidence = 100.0f * kept / count;
+    if (mad > floor_cm) {
+        confidence *= floor_cm / mad;
+    }
+    result->confidence = (uint8_t)(confidence + 0.5f);
+
+    return true;
+}
+
+// One raw range from whichever backend is configured
+static float ranging_ping(void) {
+#if CONFIG_RANGING_BACKEND_ECHO_CAPTURE
+    return echo_capture_ping();
+#else
+    return hcsr04_get_range();
+#endif
+}
+
+bool ranging_measure(ranging_result_t *result) {
+    float samples[RANGING_MAX_BURST];
+    size_t count = CONFIG_RANGING_BURST_SAMPLES;
+
+    if (count > RANGING_MAX_BURST) {
+        count = RANGING_MAX_BURST;
+    }
+
+#if CONFIG_RANGING_BACKEND_ECHO_CAPTURE
+    if (echo_capture_init() != ESP_OK) {
+        memset(result, 0, sizeof(*result));
+        return false;
+    }
+#else
+    if (!hcsr04_is_initialized()) {
+        hcsr04_init();
+    }
+#endif
+
+    // Light sleep would stall the echo timing
+    power_busy_begin();
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = ranging_ping();
+        if (i + 1 < count) {
+            // Let the previous ping's echoes die out before the next trigger
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_RANGING_BURST_GAP_MS));
+        }
+    }
+    power_busy_end();
+
+    bool ok = ranging_filter(samples, count, result);
+    if (ok) {
+        ESP_LOGI(TAG, "Burst: %.1f cm, spread %.2f cm, %u/%u samples, confidence %u%%", result->distance_cm,
+                 result->spread_cm, result->accepted, result->attempted, result->confidence);
+    } else {
+        ESP_LOGW(TAG, "Burst rejected: only %u/%u usable samples", result->accepted, result->attempted);
+    }
+    return ok;
+}
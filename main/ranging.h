@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Upper bound on pings per burst; sizes the fixed sample buffer
+#define RANGING_MAX_BURST 16
+
+typedef struct {
+    float distance_cm;  // Filtered distance for the burst
+    float spread_cm;    // Median absolute deviation of the in-range samples
+    uint8_t accepted;   // Samples that survived range and outlier rejection
+    uint8_t attempted;  // Pings fired
+    uint8_t confidence; // 0-100, from the acceptance ratio and the spread
+} ranging_result_t;
+
+// Reduce a set of raw ranges to a single reading. Returns false if too few samples are usable.
+bool ranging_filter(const float *samples, size_t count, ranging_result_t *result);
+
+// Fire a burst of CONFIG_RANGING_BURST_SAMPLES pings and filter them
+bool ranging_measure(ranging_result_t *result);
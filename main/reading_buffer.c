@@ -0,0 +1,199 @@
+#include "reading_buffer.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <string.h>
+
+#define READING_BUFFER_MAGIC 0x57424c31 // "WBL1"
+#define READING_BUFFER_NVS_NAMESPACE "readbuf"
+#define READING_BUFFER_NVS_KEY "ring"
+#define READING_BUFFER_CHECKPOINT_MIN_S 600 // Bounds flash wear through a long outage
+
+static const char *TAG = "READING_BUFFER";
+
+typedef struct {
+    uint32_t magic;
+    uint32_t next_seq;
+    uint32_t dropped;
+    uint16_t head; // Index of the oldest reading
+    uint16_t count;
+    reading_t entries[CONFIG_READING_BUFFER_CAPACITY];
+    uint32_t crc;
+} reading_ring_t;
+
+// Survives deep sleep and software resets; validated by magic and CRC after anything else
+static RTC_NOINIT_ATTR reading_ring_t ring;
+
+// Whether NVS currently holds a copy that must be cleared once the ring drains
+static bool nvs_spilled = false;
+
+// What the last NVS copy held, so a checkpoint with nothing new is skipped
+static uint32_t checkpoint_next_seq = 0;
+static int64_t checkpoint_us = 0;
+static bool checkpointed = false;
+
+static uint32_t ring_crc(const reading_ring_t *r) {
+    return esp_rom_crc32_le(0, (const uint8_t *)r, offsetof(reading_ring_t, crc));
+}
+
+static void ring_seal(void) {
+    ring.crc = ring_crc(&ring);
+}
+
+static bool ring_valid(const reading_ring_t *r) {
+    return r->magic == READING_BUFFER_MAGIC && r->count <= CONFIG_READING_BUFFER_CAPACITY &&
+           r->head < CONFIG_READING_BUFFER_CAPACITY && r->crc == ring_crc(r);
+}
+
+#if CONFIG_READING_BUFFER_NVS_SPILL
+static bool restore_from_nvs(void) {
+    nvs_handle_t handle;
+    size_t size = sizeof(ring);
+    bool restored = false;
+
+    if (nvs_open(READING_BUFFER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    if (nvs_get_blob(handle, READING_BUFFER_NVS_KEY, &ring, &size) == ESP_OK && size == sizeof(ring) &&
+        ring_valid(&ring)) {
+        restored = true;
+        nvs_spilled = true;
+    }
+    nvs_close(handle);
+    return restored;
+}
+#endif
+
+void reading_buffer_init(void) {
+    if (ring_valid(&ring)) {
+        ESP_LOGI(TAG, "Retained %u pending readings in RTC memory, next seq %lu", ring.count,
+                 (unsigned long)ring.next_seq);
+        return;
+    }
+
+#if CONFIG_READING_BUFFER_NVS_SPILL
+    if (restore_from_nvs()) {
+        ESP_LOGI(TAG, "Restored %u pending readings from NVS, next seq %lu", ring.count,
+                 (unsigned long)ring.next_seq);
+        return;
+    }
+#endif
+
+    ESP_LOGI(TAG, "No retained readings, starting empty");
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = READING_BUFFER_MAGIC;
+    ring_seal();
+}
+
+void reading_buffer_push(reading_t *reading) {
+    reading->seq = ring.next_seq++;
+
+    if (ring.count == CONFIG_READING_BUFFER_CAPACITY) {
+        ESP_LOGW(TAG, "Buffer full, dropping reading seq %lu", (unsigned long)ring.entries[ring.head].seq);
+        ring.head = (ring.head + 1) % CONFIG_READING_BUFFER_CAPACITY;
+        ring.count--;
+        ring.dropped++;
+    }
+
+    ring.entries[(ring.head + ring.count) % CONFIG_READING_BUFFER_CAPACITY] = *reading;
+    ring.count++;
+    ring_seal();
+}
+
+size_t reading_buffer_count(void) {
+    return ring.count;
+}
+
+uint32_t reading_buffer_next_seq(void) {
+    return ring.next_seq;
+}
+
+size_t reading_buffer_fix_timestamps(uint32_t first_seq, int64_t offset_s) {
+    size_t fixed = 0;
+
+    for (size_t i = 0; i < ring.count; i++) {
+        reading_t *r = &ring.entries[(ring.head + i) % CONFIG_READING_BUFFER_CAPACITY];
+
+        // Sequence numbers only grow, so the difference orders them even across a wrap
+        if ((int32_t)(r->seq - first_seq) >= 0 && (r->flags & READING_FLAG_NO_TIME)) {
+            r->timestamp = (uint32_t)(r->timestamp + offset_s);
+            r->flags &= ~READING_FLAG_NO_TIME;
+            fixed++;
+        }
+    }
+    if (fixed > 0) {
+        ring_seal();
+    }
+    return fixed;
+}
+
+size_t reading_buffer_peek(reading_t *out, size_t max) {
+    size_t n = ring.count < max ? ring.count : max;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ring.entries[(ring.head + i) % CONFIG_READING_BUFFER_CAPACITY];
+    }
+    return n;
+}
+
+void reading_buffer_consume(size_t n) {
+    if (n > ring.count) {
+        n = ring.count;
+    }
+    ring.head = (ring.head + n) % CONFIG_READING_BUFFER_CAPACITY;
+    ring.count -= n;
+    ring_seal();
+
+    if (ring.count == 0 && nvs_spilled) {
+        reading_buffer_persist();
+    }
+}
+
+void reading_buffer_persist(void) {
+#if CONFIG_READING_BUFFER_NVS_SPILL
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(READING_BUFFER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(err));
+        return;
+    }
+
+    if (ring.count == 0) {
+        // Everything was delivered; an empty ring is not worth a flash write
+        err = nvs_erase_key(handle, READING_BUFFER_NVS_KEY);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    } else {
+        err = nvs_set_blob(handle, READING_BUFFER_NVS_KEY, &ring, sizeof(ring));
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to persist readings: %s", esp_err_to_name(err));
+    } else {
+        nvs_spilled = ring.count > 0;
+        checkpoint_next_seq = ring.next_seq;
+        checkpoint_us = esp_timer_get_time();
+        checkpointed = true;
+    }
+#endif
+}
+
+void reading_buffer_checkpoint(void) {
+    if (ring.count == 0 || (checkpointed && ring.next_seq == checkpoint_next_seq)) {
+        return;
+    }
+    // The first checkpoint of a boot always goes through: after a deep-sleep wake the timer has restarted
+    if (checkpointed && esp_timer_get_time() - checkpoint_us < (int64_t)READING_BUFFER_CHECKPOINT_MIN_S * 1000000) {
+        return;
+    }
+    reading_buffer_persist();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The reading was taken before the wall clock was synchronised
+#define READING_FLAG_NO_TIME 0x01
+
+typedef struct {
+    uint32_t seq;       // Monotonic across reboots and deep sleep
+    uint32_t timestamp; // Seconds since the epoch
+    float level_cm;
+    float spread_cm;
+    uint8_t confidence;
+    uint8_t flags;
+} reading_t;
+
+// Validate the RTC-retained ring, falling back to the NVS spill copy after a power loss
+void reading_buffer_init(void);
+
+// Queue a reading, assigning its sequence number. Overwrites the oldest entry when full.
+void reading_buffer_push(reading_t *reading);
+
+size_t reading_buffer_count(void);
+
+// Sequence number the next push will assign
+uint32_t reading_buffer_next_seq(void);
+
+// Shift the timestamps of readings from first_seq on that still carry READING_FLAG_NO_TIME by offset_s, and
+// clear the flag. Used once the clock syncs, for readings taken earlier in the same boot. Returns how many.
+size_t reading_buffer_fix_timestamps(uint32_t first_seq, int64_t offset_s);
+
+// Copy up to max of the oldest pending readings without removing them
+size_t reading_buffer_peek(reading_t *out, size_t max);
+
+// Remove the n oldest readings once they have been delivered
+void reading_buffer_consume(size_t n);
+
+// Mirror the pending readings to NVS so they survive a power loss (no-op unless enabled)
+void reading_buffer_persist(void);
+
+// reading_buffer_persist, but only if readings arrived since the last copy and at most every ten minutes.
+// For when delivery is failing: a power loss then costs at most the readings since the last checkpoint.
+void reading_buffer_checkpoint(void);
@@ -0,0 +1,320 @@
+#include "runtime_config.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_scan.h"
+
+#include "sdkconfig.h"
+
+#define RUNTIME_CONFIG_MAGIC 0x57524331 // "WRC1"
+#define RUNTIME_CONFIG_NVS_NAMESPACE "runtime"
+#define RUNTIME_CONFIG_NVS_KEY "config"
+
+#define INTERVAL_MIN_S 5
+#define INTERVAL_MAX_S 86400
+#define DEADBAND_MAX_MM 1000
+#define ORPHAN_TIMEOUT_MIN_S 300
+#define ORPHAN_TIMEOUT_MAX_S 604800
+#define BLINK_MIN_MS 100
+#define BLINK_MAX_MS 10000
+
+static const char *TAG = "RUNTIME_CONFIG";
+
+typedef struct {
+    uint32_t magic;
+    runtime_config_t config;
+    uint32_t crc;
+} stored_config_t;
+
+static const runtime_config_t defaults = {
+    .version = 0,
+    .interval_min_s = CONFIG_SAMPLING_MIN_INTERVAL_S,
+    .interval_max_s = CONFIG_WATER_LEVEL_CHECK_INTERVAL_MIN * 60,
+    .deadband_mm = CONFIG_PUBLISH_DEADBAND_MM,
+    .orphan_timeout_s = CONFIG_ORPHAN_TIMEOUT_MIN * 60,
+    .led_count = 4,
+    .leds =
+        {
+            {"RED", 255, 0, 0, 1000},
+            {"GREEN", 0, 128, 0, 0},
+            {"YELLOW", 255, 255, 0, 0},
+            {"BLACK", 0, 0, 255, 1000},
+        },
+};
+
+static portMUX_TYPE config_lock = portMUX_INITIALIZER_UNLOCKED;
+static runtime_config_t config;
+
+static const char *const result_names[] = {"applied", "current", "stale", "rejected"};
+
+static uint32_t stored_crc(const stored_config_t *s) {
+    return esp_rom_crc32_le(0, (const uint8_t *)s, offsetof(stored_config_t, crc));
+}
+
+static bool load_from_nvs(runtime_config_t *out) {
+    nvs_handle_t handle;
+    stored_config_t stored;
+    size_t size = sizeof(stored);
+
+    if (nvs_open(RUNTIME_CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(handle, RUNTIME_CONFIG_NVS_KEY, &stored, &size);
+    nvs_close(handle);
+
+    if (err != ESP_OK || size != sizeof(stored) || stored.magic != RUNTIME_CONFIG_MAGIC ||
+        stored.crc != stored_crc(&stored) || stored.config.led_count > RUNTIME_CONFIG_LED_MAX) {
+        return false;
+    }
+    *out = stored.config;
+    return true;
+}
+
+static esp_err_t save_to_nvs(const runtime_config_t *c) {
+    nvs_handle_t handle;
+    stored_config_t stored = {.magic = RUNTIME_CONFIG_MAGIC, .config = *c};
+
+    stored.crc = stored_crc(&stored);
+    esp_err_t err = nvs_open(RUNTIME_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, RUNTIME_CONFIG_NVS_KEY, &stored, sizeof(stored));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+void runtime_config_init(void) {
+    runtime_config_t loaded = defaults;
+
+    if (load_from_nvs(&loaded)) {
+        ESP_LOGI(TAG, "Using config version %lu", (unsigned long)loaded.version);
+    }
+    taskENTER_CRITICAL(&config_lock);
+    config = loaded;
+    taskEXIT_CRITICAL(&config_lock);
+}
+
+static bool span_equals(const json_span_t *span, const char *s) {
+    return span->len == strlen(s) && memcmp(span->start, s, span->len) == 0;
+}
+
+static bool read_ranged(const json_span_t *value, uint32_t min, uint32_t max, uint32_t *out) {
+    uint32_t v;
+
+    if (!json_span_to_uint32(value, &v) || v < min || v > max) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// {"r": 0-255, "g": 0-255, "b": 0-255, "blink_ms": 0 or 100-10000}; missing members are 0
+static bool parse_led(const json_span_t *value, runtime_led_t *led) {
+    json_span_t key, member;
+    size_t offset = 0;
+    uint32_t v;
+
+    if (value->type != JSON_TYPE_OBJECT) {
+        return false;
+    }
+    while (json_scan_next(value->start, value->len, &offset, &key, &member)) {
+        if (span_equals(&key, "blink_ms")) {
+            if (!read_ranged(&member, 0, BLINK_MAX_MS, &v) || (v > 0 && v < BLINK_MIN_MS)) {
+                return false;
+            }
+            led->blink_ms = v;
+        } else if (key.len == 1 && (*key.start == 'r' || *key.start == 'g' || *key.start == 'b')) {
+            if (!read_ranged(&member, 0, 255, &v)) {
+                return false;
+            }
+            *(*key.start == 'r' ? &led->red : *key.start == 'g' ? &led->green : &led->blue) = v;
+        } else {
+            return false;
+        }
+    }
+    return json_scan_at_end(value->start, value->len, offset);
+}
+
+static bool parse_led_map(const json_span_t *value, runtime_config_t *c, char *error, size_t error_size) {
+    json_span_t key, member;
+    size_t offset = 0;
+
+    if (value->type != JSON_TYPE_OBJECT) {
+        snprintf(error, error_size, "led: not an object");
+        return false;
+    }
+    c->led_count = 0;
+    while (json_scan_next(value->start, value->len, &offset, &key, &member)) {
+        if (c->led_count == RUNTIME_CONFIG_LED_MAX) {
+            snprintf(error, error_size, "led: more than %d colors", RUNTIME_CONFIG_LED_MAX);
+            return false;
+        }
+        runtime_led_t *led = &c->leds[c->led_count];
+        memset(led, 0, sizeof(*led));
+        if (!json_span_to_string(&key, led->name, sizeof(led->name)) || led->name[0] == '\0') {
+            snprintf(error, error_size, "led: bad color name");
+            return false;
+        }
+        for (char *p = led->name; *p; p++) {
+            if (!isalnum((unsigned char)*p) && *p != '_') {
+                snprintf(error, error_size, "led: bad color name");
+                return false;
+            }
+            *p = toupper((unsigned char)*p);
+        }
+        if (!parse_led(&member, led)) {
+            snprintf(error, error_size, "led.%s: bad value", led->name);
+            return false;
+        }
+        c->led_count++;
+    }
+    if (!json_scan_at_end(value->start, value->len, offset)) {
+        snprintf(error, error_size, "led: malformed");
+        return false;
+    }
+    return true;
+}
+
+// Every member is checked into a copy; the copy replaces the live config only if all of them pass
+static bool parse_document(const char *json, size_t len, runtime_config_t *c, char *error, size_t error_size) {
+    const struct {
+        const char *key;
+        uint32_t *value;
+        uint32_t min, max;
+    } numbers[] = {
+        {"version", &c->version, 1, UINT32_MAX},
+        {"interval_min_s", &c->interval_min_s, INTERVAL_MIN_S, INTERVAL_MAX_S},
+        {"interval_max_s", &c->interval_max_s, INTERVAL_MIN_S, INTERVAL_MAX_S},
+        {"deadband_mm", &c->deadband_mm, 1, DEADBAND_MAX_MM},
+        {"orphan_timeout_s", &c->orphan_timeout_s, ORPHAN_TIMEOUT_MIN_S, ORPHAN_TIMEOUT_MAX_S},
+    };
+    json_span_t key, value;
+    size_t offset = 0;
+    bool has_version = false;
+
+    while (json_scan_next(json, len, &offset, &key, &value)) {
+        bool known = false;
+
+        for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]) && !known; i++) {
+            if (!span_equals(&key, numbers[i].key)) {
+                continue;
+            }
+            known = true;
+            if (!read_ranged(&value, numbers[i].min, numbers[i].max, numbers[i].value)) {
+                snprintf(error, error_size, "%s: not an integer in %lu-%lu", numbers[i].key,
+                         (unsigned long)numbers[i].min, (unsigned long)numbers[i].max);
+                return false;
+            }
+            has_version |= numbers[i].value == &c->version;
+        }
+        if (!known && span_equals(&key, "led")) {
+            known = true;
+            if (!parse_led_map(&value, c, error, error_size)) {
+                return false;
+            }
+        }
+        // A misspelt setting would otherwise be ignored without anyone noticing
+        if (!known) {
+            char name[24];
+            size_t n = 0;
+            // Goes back out inside a JSON string, so keep only characters that need no escaping
+            for (; n < key.len && n < sizeof(name) - 1; n++) {
+                name[n] = isalnum((unsigned char)key.start[n]) || key.start[n] == '_' ? key.start[n] : '?';
+            }
+            name[n] = '\0';
+            snprintf(error, error_size, "unknown setting '%s'", name);
+            return false;
+        }
+    }
+    if (!json_scan_at_end(json, len, offset)) {
+        snprintf(error, error_size, "malformed document");
+        return false;
+    }
+    if (!has_version) {
+        snprintf(error, error_size, "version missing");
+        return false;
+    }
+    if (c->interval_min_s > c->interval_max_s) {
+        snprintf(error, error_size, "interval_min_s is above interval_max_s");
+        return false;
+    }
+    return true;
+}
+
+runtime_config_result_t runtime_config_apply(const char *json, size_t len, char *error, size_t error_size) {
+    runtime_config_t candidate;
+    uint32_t current_version;
+
+    error[0] = '\0';
+    runtime_config_get(&candidate);
+    current_version = candidate.version;
+
+    if (!parse_document(json, len, &candidate, error, error_size)) {
+        ESP_LOGW(TAG, "Config rejected: %s", error);
+        return RUNTIME_CONFIG_REJECTED;
+    }
+    if (candidate.version == current_version) {
+        return RUNTIME_CONFIG_CURRENT;
+    }
+    if (candidate.version < current_version) {
+        snprintf(error, error_size, "version %lu is in effect", (unsigned long)current_version);
+        return RUNTIME_CONFIG_STALE;
+    }
+
+    taskENTER_CRITICAL(&config_lock);
+    config = candidate;
+    taskEXIT_CRITICAL(&config_lock);
+
+    // Running on settings that are lost at the next reboot beats not running on them at all
+    esp_err_t err = save_to_nvs(&candidate);
+    if (err != ESP_OK) {
+        snprintf(error, error_size, "not persisted: %s", esp_err_to_name(err));
+        ESP_LOGW(TAG, "Config version %lu %s", (unsigned long)candidate.version, error);
+    }
+    ESP_LOGI(TAG, "Config version %lu applied", (unsigned long)candidate.version);
+    return RUNTIME_CONFIG_APPLIED;
+}
+
+void runtime_config_get(runtime_config_t *out) {
+    taskENTER_CRITICAL(&config_lock);
+    *out = config;
+    taskEXIT_CRITICAL(&config_lock);
+}
+
+uint32_t runtime_config_version(void) {
+    uint32_t version;
+
+    taskENTER_CRITICAL(&config_lock);
+    version = config.version;
+    taskEXIT_CRITICAL(&config_lock);
+    return version;
+}
+
+bool runtime_config_led(const char *name, runtime_led_t *out) {
+    bool found = false;
+
+    taskENTER_CRITICAL(&config_lock);
+    for (size_t i = 0; i < config.led_count && !found; i++) {
+        if (strcmp(config.leds[i].name, name) == 0) {
+            *out = config.leds[i];
+            found = true;
+        }
+    }
+    taskEXIT_CRITICAL(&config_lock);
+    return found;
+}
+
+const char *runtime_config_result_name(runtime_config_result_t result) {
+    return result <= RUNTIME_CONFIG_REJECTED ? result_names[result] : "?";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gecl-rgb-led-manager.h"
+
+#define RUNTIME_CONFIG_LED_MAX 8
+#define RUNTIME_CONFIG_LED_NAME_MAX 12
+
+/*
+ * Settings that can change without an OTA. A desired-state document, in the manner of a device shadow, arrives on
+ * <config topic>/<device id>:
+ *
+ *   {"version": 7, "interval_min_s": 20, "interval_max_s": 600, "deadband_mm": 5, "orphan_timeout_s": 7200,
+ *    "led": {"RED": {"r": 255, "g": 0, "b": 0, "blink_ms": 1000}, "BLACK": {}}}
+ *
+ * Members left out keep their current value; "led" replaces the whole status color map, and an entry with no
+ * color turns the LED off, as does dropping the color being shown. A document takes effect only if its version is
+ * newer than the one in effect and every member validates; it is then persisted to NVS, so it survives reboots and
+ * deep sleep.
+ */
+typedef struct {
+    char name[RUNTIME_CONFIG_LED_NAME_MAX]; // Status color as the status service sends it, upper case
+    uint8_t red, green, blue;
+    uint16_t blink_ms; // 0 for solid
+} runtime_led_t;
+
+typedef struct {
+    uint32_t version; // 0 until a document has been applied
+    uint32_t interval_min_s;
+    uint32_t interval_max_s;
+    uint32_t deadband_mm;
+    uint32_t orphan_timeout_s;
+    uint8_t led_count;
+    runtime_led_t leds[RUNTIME_CONFIG_LED_MAX];
+} runtime_config_t;
+
+typedef enum {
+    RUNTIME_CONFIG_APPLIED,
+    RUNTIME_CONFIG_CURRENT,  // Same version as in effect, e.g. the retained document again after a reconnect
+    RUNTIME_CONFIG_STALE,    // Older than the version in effect
+    RUNTIME_CONFIG_REJECTED, // Malformed, or a member out of range; nothing changed
+} runtime_config_result_t;
+
+// Load the persisted settings, or the Kconfig defaults if there are none
+void runtime_config_init(void);
+
+// Validate and take on a desired-state document. error gets a short reason, or "" if there is nothing to report.
+runtime_config_result_t runtime_config_apply(const char *json, size_t len, char *error, size_t error_size);
+
+// Safe from any task
+void runtime_config_get(runtime_config_t *out);
+uint32_t runtime_config_version(void);
+
+// Look up a status color in the map; false if it has no entry
+bool runtime_config_led(const char *name, runtime_led_t *out);
+
+const char *runtime_config_result_name(runtime_config_result_t result);
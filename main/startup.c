@@ -0,0 +1,70 @@
+#include "startup.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <assert.h>
+#include <stdio.h>
+
+static const char *TAG = "STARTUP";
+
+static const char *const stage_names[] = {"nvs", "led", "sensor", "wifi", "time", "mqtt"};
+static_assert(sizeof(stage_names) / sizeof(stage_names[0]) == STARTUP_STAGE_COUNT, "stage name missing");
+
+static EventGroupHandle_t startup_events = NULL;
+static int64_t begin_us[STARTUP_STAGE_COUNT];
+static uint32_t duration_ms[STARTUP_STAGE_COUNT];
+
+void startup_init(void) {
+    startup_events = xEventGroupCreate();
+    assert(startup_events != NULL);
+}
+
+void startup_begin(startup_stage_t stage) {
+    if (!startup_is_done(stage)) {
+        begin_us[stage] = esp_timer_get_time();
+    }
+}
+
+void startup_done(startup_stage_t stage) {
+    if (startup_is_done(stage)) {
+        return;
+    }
+    duration_ms[stage] = (esp_timer_get_time() - begin_us[stage]) / 1000;
+    if (duration_ms[stage] == 0) {
+        duration_ms[stage] = 1; // 0 means pending
+    }
+    xEventGroupSetBits(startup_events, STARTUP_BIT(stage));
+    ESP_LOGI(TAG, "%s ready after %lu ms (%lu ms since boot)", stage_names[stage], (unsigned long)duration_ms[stage],
+             (unsigned long)(esp_timer_get_time() / 1000));
+}
+
+bool startup_is_done(startup_stage_t stage) {
+    return (xEventGroupGetBits(startup_events) & STARTUP_BIT(stage)) != 0;
+}
+
+bool startup_wait(EventBits_t bits, TickType_t timeout) {
+    return (xEventGroupWaitBits(startup_events, bits, pdFALSE, pdTRUE, timeout) & bits) == bits;
+}
+
+uint32_t startup_stage_ms(startup_stage_t stage) {
+    return startup_is_done(stage) ? duration_ms[stage] : 0;
+}
+
+const char *startup_stage_name(startup_stage_t stage) {
+    return stage_names[stage];
+}
+
+void startup_log_summary(void) {
+    char line[160];
+    int len = 0;
+
+    for (size_t i = 0; i < STARTUP_STAGE_COUNT && len < (int)sizeof(line); i++) {
+        if (startup_is_done(i)) {
+            len += snprintf(line + len, sizeof(line) - len, " %s=%lums", stage_names[i],
+                            (unsigned long)duration_ms[i]);
+        } else {
+            len += snprintf(line + len, sizeof(line) - len, " %s=pending", stage_names[i]);
+        }
+    }
+    ESP_LOGI(TAG, "Startup stages:%s", line);
+}
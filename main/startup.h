@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/*
+ * Startup as a set of stages that run concurrently and signal completion through one event group, so each
+ * stage waits only on what it actually depends on. Durations are kept for the log and the metrics report.
+ */
+typedef enum {
+    STARTUP_STAGE_NVS,    // NVS and the retained reading buffer
+    STARTUP_STAGE_LED,
+    STARTUP_STAGE_SENSOR, // First reading taken and buffered
+    STARTUP_STAGE_WIFI,   // Station has an IP address
+    STARTUP_STAGE_TIME,   // Wall clock synced
+    STARTUP_STAGE_MQTT,   // First MQTT_EVENT_CONNECTED
+    STARTUP_STAGE_COUNT,
+} startup_stage_t;
+
+#define STARTUP_BIT(stage) ((EventBits_t)1 << (stage))
+#define STARTUP_ALL_BITS (STARTUP_BIT(STARTUP_STAGE_COUNT) - 1)
+
+// Create the event group. Call first thing in app_main.
+void startup_init(void);
+
+void startup_begin(startup_stage_t stage);
+
+// Record the duration and release waiters; later calls for the same stage are ignored
+void startup_done(startup_stage_t stage);
+
+bool startup_is_done(startup_stage_t stage);
+
+// Wait until every stage in bits is done. Returns false on timeout.
+bool startup_wait(EventBits_t bits, TickType_t timeout);
+
+// Duration in milliseconds, 0 until the stage is done
+uint32_t startup_stage_ms(startup_stage_t stage);
+
+const char *startup_stage_name(startup_stage_t stage);
+
+// One log line with every stage's duration; pending stages are marked as such
+void startup_log_summary(void);
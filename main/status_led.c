@@ -0,0 +1,239 @@
+#include "status_led.h"
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#if CONFIG_STATUS_LED_DRIVER_LEDC
+#include "driver/ledc.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LED_MODE LEDC_LOW_SPEED_MODE
+#define LED_TIMER LEDC_TIMER_0
+#define LED_RESOLUTION LEDC_TIMER_10_BIT
+#define LED_DUTY_MAX ((1 << 10) - 1)
+#define LED_PWM_HZ 1000
+#define LED_CHANNEL_COUNT 3
+#define LED_FADE_MARGIN_MS 50 // Past the nominal fade time before a fade is taken as ended without its interrupt
+
+#define LED_NOTIFY_PATTERN (1 << 0)   // status_led_set changed the pattern
+#define LED_NOTIFY_FADE_DONE (1 << 1) // The lead channel finished a fade
+
+static const char *TAG = "STATUS_LED";
+
+static const ledc_channel_t channels[LED_CHANNEL_COUNT] = {LEDC_CHANNEL_0, LEDC_CHANNEL_1, LEDC_CHANNEL_2};
+static const int gpios[LED_CHANNEL_COUNT] = {CONFIG_STATUS_LED_RED_GPIO, CONFIG_STATUS_LED_GREEN_GPIO,
+                                             CONFIG_STATUS_LED_BLUE_GPIO};
+
+typedef struct {
+    uint8_t rgb[LED_CHANNEL_COUNT];
+    led_state_t state;
+    int period_ms;
+} led_pattern_t;
+
+static TaskHandle_t led_task_handle = NULL;
+static portMUX_TYPE pattern_lock = portMUX_INITIALIZER_UNLOCKED;
+static led_pattern_t pattern;
+static volatile size_t lead = 0; // Channel whose fade-end callback paces the blink
+
+static uint32_t to_duty(uint8_t level) {
+    uint32_t duty = (uint32_t)level * LED_DUTY_MAX / 255;
+#if CONFIG_STATUS_LED_ACTIVE_LOW
+    duty = LED_DUTY_MAX - duty;
+#endif
+    return duty;
+}
+
+// Runs in the LEDC ISR; the fade itself needed no CPU, only turning it around does
+static bool IRAM_ATTR fade_done_callback(const ledc_cb_param_t *param, void *arg) {
+    BaseType_t higher_priority_woken = pdFALSE;
+
+    if (param->event == LEDC_FADE_END_EVT && (size_t)arg == lead) {
+        xTaskNotifyFromISR(led_task_handle, LED_NOTIFY_FADE_DONE, eSetBits, &higher_priority_woken);
+    }
+    return higher_priority_woken == pdTRUE;
+}
+
+// The brightest channel takes longest in absolute terms, so its fade-end callback paces the blink
+static size_t lead_channel(const led_pattern_t *p) {
+    size_t brightest = 0;
+    for (size_t i = 1; i < LED_CHANNEL_COUNT; i++) {
+        if (p->rgb[i] > p->rgb[brightest]) {
+            brightest = i;
+        }
+    }
+    return brightest;
+}
+
+static void set_levels(const led_pattern_t *p, bool on) {
+    for (size_t i = 0; i < LED_CHANNEL_COUNT; i++) {
+        ledc_set_duty(LED_MODE, channels[i], to_duty(on ? p->rgb[i] : 0));
+        ledc_update_duty(LED_MODE, channels[i]);
+    }
+}
+
+static void start_fade(const led_pattern_t *p, bool up) {
+    int fade_ms = p->period_ms / 2;
+
+    for (size_t i = 0; i < LED_CHANNEL_COUNT; i++) {
+        ledc_set_fade_with_time(LED_MODE, channels[i], to_duty(up ? p->rgb[i] : 0), fade_ms);
+        ledc_fade_start(LED_MODE, channels[i], LEDC_FADE_NO_WAIT);
+    }
+}
+
+static void stop_fades(void) {
+    for (size_t i = 0; i < LED_CHANNEL_COUNT; i++) {
+        ledc_fade_stop(LED_MODE, channels[i]);
+    }
+    // A fade that ended before the stop must not flip the next phase
+    ulTaskNotifyValueClear(NULL, LED_NOTIFY_FADE_DONE);
+}
+
+static void status_led_task(void *pvParameter) {
+    led_pattern_t current = {0};
+    bool fading_up = false;
+
+    while (1) {
+        uint32_t notified = 0;
+        bool blinking = current.state == LED_STATE_BLINK && current.period_ms > 0;
+
+        /*
+         * LEDC is not a light-sleep wake source on the C3, so with automatic light sleep the fade-end interrupt
+         * can wait until something else wakes the CPU. A bounded wait while blinking makes tickless idle arm a
+         * timer wake-up for the end of the fade; if it runs out first, the fade is taken as ended.
+         */
+        TickType_t wait = blinking ? pdMS_TO_TICKS(current.period_ms / 2 + LED_FADE_MARGIN_MS) : portMAX_DELAY;
+        if (xTaskNotifyWait(0, UINT32_MAX, &notified, wait) == pdFALSE && blinking) {
+            stop_fades();
+            notified = LED_NOTIFY_FADE_DONE;
+        }
+
+        if (notified & LED_NOTIFY_PATTERN) {
+            taskENTER_CRITICAL(&pattern_lock);
+            current = pattern;
+            taskEXIT_CRITICAL(&pattern_lock);
+            stop_fades();
+
+            if (current.state != LED_STATE_BLINK || current.period_ms <= 0) {
+                set_levels(&current, current.state == LED_STATE_SOLID);
+                continue;
+            }
+            set_levels(&current, false);
+            fading_up = true;
+        } else if (current.state == LED_STATE_BLINK && (notified & LED_NOTIFY_FADE_DONE)) {
+            fading_up = !fading_up;
+        } else {
+            continue;
+        }
+
+        lead = lead_channel(&current);
+        start_fade(&current, fading_up);
+    }
+}
+
+void status_led_init(void) {
+    ledc_timer_config_t timer = {
+        .speed_mode = LED_MODE,
+        .duty_resolution = LED_RESOLUTION,
+        .timer_num = LED_TIMER,
+        .freq_hz = LED_PWM_HZ,
+#if CONFIG_LOW_POWER_CONNECTED
+        // RC_FAST keeps running through light sleep, so the PWM and fades do too
+        .clk_cfg = LEDC_USE_RC_FAST_CLK,
+#else
+        .clk_cfg = LEDC_AUTO_CLK,
+#endif
+    };
+
+    esp_err_t err = ledc_timer_config(&timer);
+    for (size_t i = 0; i < LED_CHANNEL_COUNT && err == ESP_OK; i++) {
+        ledc_channel_config_t channel = {
+            .gpio_num = gpios[i],
+            .speed_mode = LED_MODE,
+            .channel = channels[i],
+            .timer_sel = LED_TIMER,
+            .duty = to_duty(0),
+        };
+        err = ledc_channel_config(&channel);
+    }
+    if (err == ESP_OK) {
+        err = ledc_fade_func_install(0);
+    }
+    ledc_cbs_t callbacks = {.fade_cb = fade_done_callback};
+    for (size_t i = 0; i < LED_CHANNEL_COUNT && err == ESP_OK; i++) {
+        err = ledc_cb_register(LED_MODE, channels[i], &callbacks, (void *)i);
+    }
+    if (err == ESP_OK && xTaskCreate(&status_led_task, "status_led_task", 2048, NULL, 4, &led_task_handle) != pdPASS) {
+        err = ESP_ERR_NO_MEM;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up the LEDC status LED: %s", esp_err_to_name(err));
+    }
+}
+
+void status_led_set(uint8_t red, uint8_t green, uint8_t blue, led_state_t state, int period_ms) {
+    if (led_task_handle == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&pattern_lock);
+    pattern = (led_pattern_t){.rgb = {red, green, blue}, .state = state, .period_ms = period_ms};
+    taskEXIT_CRITICAL(&pattern_lock);
+    xTaskNotify(led_task_handle, LED_NOTIFY_PATTERN, eSetBits);
+}
+
+typedef struct {
+    const char *name;
+    uint8_t red, green, blue;
+} named_color_t;
+
+static const named_color_t named_colors[] = {
+    {"WHITE", 255, 255, 255}, {"RED", 255, 0, 0},    {"GREEN", 0, 128, 0},
+    {"BLUE", 0, 0, 255},      {"YELLOW", 255, 255, 0},
+};
+
+#define NAMED_BLINK_PERIOD_MS 1000
+
+// "LED_OFF", "LED_<SOLID|BLINK>_<COLOR>"
+void status_led_set_named(const char *name) {
+    led_state_t state;
+    const char *color;
+
+    if (strcmp(name, "LED_OFF") == 0) {
+        status_led_set(0, 0, 0, LED_STATE_OFF, 0);
+        return;
+    } else if (strncmp(name, "LED_BLINK_", 10) == 0) {
+        state = LED_STATE_BLINK;
+        color = name + 10;
+    } else if (strncmp(name, "LED_SOLID_", 10) == 0) {
+        state = LED_STATE_SOLID;
+        color = name + 10;
+    } else {
+        ESP_LOGW(TAG, "Unknown LED pattern: %s", name);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(named_colors) / sizeof(named_colors[0]); i++) {
+        if (strcmp(color, named_colors[i].name) == 0) {
+            status_led_set(named_colors[i].red, named_colors[i].green, named_colors[i].blue, state,
+                           state == LED_STATE_BLINK ? NAMED_BLINK_PERIOD_MS : 0);
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Unknown LED color: %s", name);
+}
+#else
+void status_led_init(void) {
+    init_rgb_led();
+}
+
+void status_led_set(uint8_t red, uint8_t green, uint8_t blue, led_state_t state, int period_ms) {
+    set_rgb_led_enumerated_values(red, green, blue, state, period_ms);
+}
+
+void status_led_set_named(const char *name) {
+    set_rgb_led_named_color(name);
+}
+#endif
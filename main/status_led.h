@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gecl-rgb-led-manager.h"
+
+/*
+ * Front for the status LED. With CONFIG_STATUS_LED_DRIVER_LEDC the LED is a discrete RGB LED on three LEDC
+ * channels and blinking runs on the hardware fade engine: the CPU only wakes to turn each fade around, instead
+ * of software timers ticking the pattern. Otherwise calls go straight to the gecl RGB LED manager.
+ */
+
+void status_led_init(void);
+
+// Same arguments as set_rgb_led_enumerated_values; a blink fades up and back down once per period
+void status_led_set(uint8_t red, uint8_t green, uint8_t blue, led_state_t state, int period_ms);
+
+// Named patterns such as "LED_BLINK_WHITE", as understood by set_rgb_led_named_color
+void status_led_set_named(const char *name);
@@ -0,0 +1,262 @@
+#include "supervisor.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <assert.h>
+
+#include "gecl-misc-util-manager.h"
+
+#include "metrics.h"
+#include "topic_router.h"
+
+#define SUPERVISOR_QUEUE_LENGTH 8
+#define SUPERVISOR_WIFI_SETTLE_MS 100 // Between dropping the association and asking for a new one
+#define SUPERVISOR_MAX_RUNGS 4
+
+static const char *TAG = "SUPERVISOR";
+
+typedef struct {
+    bool is_fault;
+    uint8_t code; // supervisor_fault_t or supervisor_signal_t
+} supervisor_event_t;
+
+typedef struct {
+    supervisor_step_t rungs[SUPERVISOR_MAX_RUNGS];
+    uint8_t rung_count;
+    supervisor_signal_t proof;    // What closes the incident
+    metric_restart_cause_t cause; // Recorded if it ends in a reboot
+} ladder_t;
+
+// Connection faults stop short of rebooting unless the reconnect logic itself gives up
+static const ladder_t ladders[SUPERVISOR_FAULT_COUNT] = {
+    [SUPERVISOR_FAULT_BAD_MESSAGE] = {{SUPERVISOR_STEP_DROP}, 1, SUPERVISOR_SIGNAL_MESSAGE,
+                                      METRIC_RESTART_BAD_MESSAGE},
+    [SUPERVISOR_FAULT_ORPHAN] = {{SUPERVISOR_STEP_RESUBSCRIBE, SUPERVISOR_STEP_RESTART_MQTT,
+                                  SUPERVISOR_STEP_RESTART_WIFI, SUPERVISOR_STEP_REBOOT},
+                                 4, SUPERVISOR_SIGNAL_MESSAGE, METRIC_RESTART_ORPHAN_TIMER},
+    [SUPERVISOR_FAULT_MQTT_ERROR] = {{SUPERVISOR_STEP_WAIT, SUPERVISOR_STEP_RESTART_MQTT, SUPERVISOR_STEP_RESTART_WIFI},
+                                     3, SUPERVISOR_SIGNAL_CONNECTED, METRIC_RESTART_MQTT_ERROR},
+    [SUPERVISOR_FAULT_MQTT_GIVE_UP] = {{SUPERVISOR_STEP_RESTART_WIFI, SUPERVISOR_STEP_REBOOT}, 2,
+                                       SUPERVISOR_SIGNAL_CONNECTED, METRIC_RESTART_MQTT_GIVE_UP},
+    [SUPERVISOR_FAULT_INTERNAL] = {{SUPERVISOR_STEP_REBOOT}, 1, SUPERVISOR_SIGNAL_CONNECTED,
+                                   METRIC_RESTART_INTERNAL},
+};
+
+static const char *const step_names[] = {"drop", "wait", "resubscribe", "restart_mqtt", "restart_wifi", "reboot"};
+static_assert(sizeof(step_names) / sizeof(step_names[0]) == SUPERVISOR_STEP_COUNT, "step name missing");
+
+static const char *const fault_names[] = {"bad_message", "orphan", "mqtt_error", "mqtt_give_up", "internal"};
+static_assert(sizeof(fault_names) / sizeof(fault_names[0]) == SUPERVISOR_FAULT_COUNT, "fault name missing");
+
+static QueueHandle_t event_queue = NULL;
+static esp_mqtt_client_handle_t supervised_client = NULL;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static supervisor_stats_t stats;
+
+// Owned by the supervisor task
+static struct {
+    supervisor_fault_t fault;
+    uint8_t rung;
+    int64_t start_us;
+    TickType_t step_deadline;
+} incident;
+static bool mqtt_up = false;
+
+static supervisor_step_t current_step(void) {
+    return ladders[incident.fault].rungs[incident.rung];
+}
+
+static void reboot(metric_restart_cause_t cause) {
+    metrics_note_restart(cause);
+    error_reload(supervised_client);
+}
+
+static void run_step(void) {
+    supervisor_step_t step = current_step();
+    esp_err_t err = ESP_OK;
+
+    incident.step_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_SUPERVISOR_STEP_TIMEOUT_S * 1000);
+    ESP_LOGW(TAG, "%s: %s", fault_names[incident.fault], step_names[step]);
+
+    switch (step) {
+    case SUPERVISOR_STEP_DROP:
+    case SUPERVISOR_STEP_WAIT:
+        break;
+    case SUPERVISOR_STEP_RESUBSCRIBE:
+        // While disconnected the connected handler resubscribes anyway
+        if (mqtt_up && supervised_client != NULL) {
+            topic_router_subscribe_all(supervised_client);
+        }
+        break;
+    case SUPERVISOR_STEP_RESTART_MQTT:
+        if (supervised_client == NULL) {
+            break;
+        }
+        // A disconnect hands over to the reconnect backoff, which starts again from its shortest delay
+        err = mqtt_up ? esp_mqtt_client_disconnect(supervised_client) : esp_mqtt_client_reconnect(supervised_client);
+        break;
+    case SUPERVISOR_STEP_RESTART_WIFI:
+        err = esp_wifi_disconnect();
+        vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_WIFI_SETTLE_MS));
+        if (err == ESP_OK || err == ESP_ERR_WIFI_NOT_CONNECT) {
+            err = esp_wifi_connect();
+        }
+        break;
+    case SUPERVISOR_STEP_REBOOT:
+    default:
+        reboot(ladders[incident.fault].cause);
+        break;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Recovery step %s failed: %s", step_names[step], esp_err_to_name(err));
+    }
+}
+
+static void close_incident(void) {
+    supervisor_step_t step = current_step();
+    uint32_t elapsed_ms = (esp_timer_get_time() - incident.start_us) / 1000;
+
+    taskENTER_CRITICAL(&stats_lock);
+    stats.open = false;
+    stats.recovered[step]++;
+    stats.last_recovery_ms = elapsed_ms;
+    taskEXIT_CRITICAL(&stats_lock);
+
+    // Dropped messages cost no downtime; keep them out of the time-to-recover figures
+    if (step != SUPERVISOR_STEP_DROP) {
+        metrics_observe(METRIC_HIST_RECOVERY_MS, elapsed_ms);
+        ESP_LOGI(TAG, "%s recovered by %s in %lu ms", fault_names[incident.fault], step_names[step],
+                 (unsigned long)elapsed_ms);
+    }
+}
+
+static void handle_fault(supervisor_fault_t fault) {
+    const ladder_t *ladder = &ladders[fault];
+
+    metrics_count(METRIC_FAULTS);
+    if (!stats.open) {
+        incident.fault = fault;
+        incident.rung = 0;
+        incident.start_us = esp_timer_get_time();
+        taskENTER_CRITICAL(&stats_lock);
+        stats.incidents++;
+        stats.open = true;
+        taskEXIT_CRITICAL(&stats_lock);
+
+        run_step();
+        if (current_step() == SUPERVISOR_STEP_DROP) {
+            close_incident();
+        }
+        return;
+    }
+
+    // Only ever move up: switch to this fault's ladder at its first rung above where the incident is
+    for (uint8_t rung = 0; rung < ladder->rung_count; rung++) {
+        if (ladder->rungs[rung] > current_step()) {
+            incident.fault = fault;
+            incident.rung = rung;
+            run_step();
+            return;
+        }
+    }
+}
+
+static void handle_signal(supervisor_signal_t signal) {
+    if (signal == SUPERVISOR_SIGNAL_CONNECTED) {
+        mqtt_up = true;
+    } else if (signal == SUPERVISOR_SIGNAL_DISCONNECTED) {
+        mqtt_up = false;
+    }
+    if (stats.open && signal == ladders[incident.fault].proof) {
+        close_incident();
+    }
+}
+
+static void escalate(void) {
+    if (incident.rung + 1 < ladders[incident.fault].rung_count) {
+        incident.rung++;
+        run_step();
+        return;
+    }
+    // Top of this ladder; keep waiting for the proof, or for a fault that warrants more
+    incident.step_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_SUPERVISOR_STEP_TIMEOUT_S * 1000);
+    ESP_LOGW(TAG, "%s: still waiting after %s", fault_names[incident.fault], step_names[current_step()]);
+}
+
+static void supervisor_task(void *pvParameter) {
+    supervisor_event_t event;
+
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        if (stats.open) {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(incident.step_deadline - now) > 0 ? incident.step_deadline - now : 0;
+        }
+
+        if (xQueueReceive(event_queue, &event, wait) != pdTRUE) {
+            escalate();
+        } else if (event.is_fault) {
+            handle_fault(event.code);
+        } else {
+            handle_signal(event.code);
+        }
+    }
+}
+
+esp_err_t supervisor_start(void) {
+    if (event_queue != NULL) {
+        return ESP_OK;
+    }
+    event_queue = xQueueCreate(SUPERVISOR_QUEUE_LENGTH, sizeof(supervisor_event_t));
+    if (event_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(&supervisor_task, "supervisor_task", 3072, NULL, 6, NULL) != pdPASS) {
+        vQueueDelete(event_queue);
+        event_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void supervisor_attach_mqtt(esp_mqtt_client_handle_t client) {
+    supervised_client = client;
+}
+
+void supervisor_report(supervisor_fault_t fault) {
+    supervisor_event_t event = {.is_fault = true, .code = fault};
+
+    if (event_queue == NULL) {
+        ESP_LOGE(TAG, "%s before the supervisor started. Restarting", fault_names[fault]);
+        reboot(ladders[fault].cause);
+        return;
+    }
+    if (xQueueSend(event_queue, &event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Queue full, %s not recorded", fault_names[fault]);
+    }
+}
+
+void supervisor_signal(supervisor_signal_t signal) {
+    supervisor_event_t event = {.is_fault = false, .code = signal};
+
+    // Messages only matter while an incident waits for one; skip the queue for the steady stream of them
+    if (event_queue == NULL || (signal == SUPERVISOR_SIGNAL_MESSAGE && !stats.open)) {
+        return;
+    }
+    // A lost signal only delays recovery by a step; the next message or connect proves it again
+    xQueueSend(event_queue, &event, 0);
+}
+
+void supervisor_get_stats(supervisor_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+const char *supervisor_step_name(supervisor_step_t step) {
+    return step < SUPERVISOR_STEP_COUNT ? step_names[step] : "?";
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+/*
+ * Faults are reported here instead of rebooting on the spot. The supervisor task opens an incident and works up a
+ * recovery ladder, one step per CONFIG_SUPERVISOR_STEP_TIMEOUT_S, until the signal that proves the fault cleared
+ * arrives. Each fault starts at its own step and has a ceiling: only faults that a reboot can plausibly fix go all
+ * the way up. A fault reported during an open incident can only move it further up the ladder.
+ */
+typedef enum {
+    SUPERVISOR_FAULT_BAD_MESSAGE,  // Unparseable message; dropped, nothing else to do
+    SUPERVISOR_FAULT_ORPHAN,       // No status message for the orphan timeout
+    SUPERVISOR_FAULT_MQTT_ERROR,   // MQTT_EVENT_ERROR
+    SUPERVISOR_FAULT_MQTT_GIVE_UP, // Reconnect backoff ran past CONFIG_MQTT_RECONNECT_GIVE_UP_MIN
+    SUPERVISOR_FAULT_INTERNAL,     // A timer or task could not be created or reset
+    SUPERVISOR_FAULT_COUNT,
+} supervisor_fault_t;
+
+// In escalation order
+typedef enum {
+    SUPERVISOR_STEP_DROP,         // Nothing beyond dropping the message
+    SUPERVISOR_STEP_WAIT,         // Let the MQTT reconnect backoff do its job
+    SUPERVISOR_STEP_RESUBSCRIBE,
+    SUPERVISOR_STEP_RESTART_MQTT, // Tear down the MQTT session and reconnect
+    SUPERVISOR_STEP_RESTART_WIFI, // Drop the association and reconnect
+    SUPERVISOR_STEP_REBOOT,
+    SUPERVISOR_STEP_COUNT,
+} supervisor_step_t;
+
+// Evidence that things work again
+typedef enum {
+    SUPERVISOR_SIGNAL_CONNECTED,    // MQTT_EVENT_CONNECTED
+    SUPERVISOR_SIGNAL_DISCONNECTED, // MQTT_EVENT_DISCONNECTED; not evidence, but tells the ladder what is up
+    SUPERVISOR_SIGNAL_MESSAGE,      // A subscribed message was handled
+} supervisor_signal_t;
+
+typedef struct {
+    uint32_t incidents;                        // Opened, including ones still open
+    uint32_t recovered[SUPERVISOR_STEP_COUNT]; // Closed, by the step that was in effect
+    uint32_t last_recovery_ms;
+    bool open;
+} supervisor_stats_t;
+
+// Start the supervisor task. Call early; faults reported before this reboot straight away.
+esp_err_t supervisor_start(void);
+
+// The client the MQTT recovery steps act on
+void supervisor_attach_mqtt(esp_mqtt_client_handle_t client);
+
+// Never blocks; safe from any task and from timer callbacks
+void supervisor_report(supervisor_fault_t fault);
+void supervisor_signal(supervisor_signal_t signal);
+
+void supervisor_get_stats(supervisor_stats_t *stats);
+
+const char *supervisor_step_name(supervisor_step_t step);
@@ -0,0 +1,110 @@
+#include "telemetry.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "provisioning.h"
+#include "sdkconfig.h"
+
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p = put_u16(p, v & 0xffff);
+    return put_u16(p, v >> 16);
+}
+
+static uint16_t to_mm_u16(float cm) {
+    float mm = cm * 10.0f + 0.5f;
+    return mm <= 0.0f ? 0 : mm >= UINT16_MAX ? UINT16_MAX : (uint16_t)mm;
+}
+
+static int encode_binary(const reading_t *readings, size_t count, char *payload, size_t size) {
+    size_t needed = TELEMETRY_BINARY_HEADER_SIZE + count * TELEMETRY_BINARY_RECORD_SIZE;
+    uint8_t *p = (uint8_t *)payload;
+
+    if (count > UINT8_MAX) {
+        return -1;
+    }
+    if (needed > size) {
+        return needed;
+    }
+
+    *p++ = TELEMETRY_BINARY_VERSION;
+    *p++ = count;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t spread = to_mm_u16(readings[i].spread_cm);
+
+        p = put_u32(p, readings[i].seq);
+        p = put_u32(p, readings[i].timestamp);
+        p = put_u16(p, to_mm_u16(readings[i].level_cm));
+        *p++ = spread > UINT8_MAX ? UINT8_MAX : spread;
+        *p++ = readings[i].confidence;
+        *p++ = readings[i].flags;
+    }
+    return needed;
+}
+
+#else
+
+// One reading keeps the legacy single-message payload; several become a batched array
+static int encode_json(const reading_t *readings, size_t count, char *payload, size_t size) {
+    int len;
+
+    if (count == 1) {
+        return snprintf(payload, size,
+                        "{\"water_level\": \"%.1f\", \"spread\": \"%.2f\", \"confidence\": %u, \"seq\": %lu, "
+                        "\"ts\": %lu, \"hostname\": \"%s\" }",
+                        readings[0].level_cm, readings[0].spread_cm, readings[0].confidence,
+                        (unsigned long)readings[0].seq, (unsigned long)readings[0].timestamp,
+                        provisioning_get()->location);
+    }
+
+    len = snprintf(payload, size, "{\"hostname\": \"%s\", \"readings\": [", provisioning_get()->location);
+    for (size_t i = 0; i < count; i++) {
+        len += snprintf(payload + (len < (int)size ? len : 0), len < (int)size ? size - len : 0,
+                        "%s{\"water_level\": \"%.1f\", \"spread\": \"%.2f\", \"confidence\": %u, \"seq\": %lu, "
+                        "\"ts\": %lu}",
+                        i ? ", " : "", readings[i].level_cm, readings[i].spread_cm, readings[i].confidence,
+                        (unsigned long)readings[i].seq, (unsigned long)readings[i].timestamp);
+    }
+    len += snprintf(payload + (len < (int)size ? len : 0), len < (int)size ? size - len : 0, "]}");
+    return len;
+}
+
+#endif
+
+int telemetry_encode(const reading_t *readings, size_t count, char *payload, size_t size) {
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+    return encode_binary(readings, count, payload, size);
+#else
+    return encode_json(readings, count, payload, size);
+#endif
+}
+
+const char *telemetry_topic(void) {
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+    // Only ever called from the reading task, and the location is fixed once provisioning has loaded
+    static char topic[160];
+
+    if (topic[0] == '\0') {
+        snprintf(topic, sizeof(topic), "%s/%s/bin", provisioning_get()->level_topic, provisioning_get()->location);
+    }
+    return topic;
+#else
+    return provisioning_get()->level_topic;
+#endif
+}
+
+int telemetry_encode_event(const level_event_t *event, char *payload, size_t size) {
+    return snprintf(payload, size,
+                    "{\"hostname\": \"%s\", \"event\": \"%s\", \"start\": %lu, \"end\": %lu, \"from\": %.1f, "
+                    "\"to\": %.1f}",
+                    provisioning_get()->location, level_event_name(event->type), (unsigned long)event->start,
+                    (unsigned long)event->end, event->start_cm, event->end_cm);
+}
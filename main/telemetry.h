@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "level_tracker.h"
+#include "reading_buffer.h"
+
+/*
+ * Binary layout (CONFIG_TELEMETRY_FORMAT_BINARY), all fields little-endian:
+ *
+ *   header   u8 version (TELEMETRY_BINARY_VERSION), u8 record count
+ *   record   u32 seq, u32 timestamp, u16 level (mm), u8 spread (mm, saturating),
+ *            u8 confidence (0-100), u8 flags (READING_FLAG_*)
+ *
+ * The device identity is carried by the topic rather than the payload.
+ */
+#define TELEMETRY_BINARY_VERSION 1
+#define TELEMETRY_BINARY_HEADER_SIZE 2
+#define TELEMETRY_BINARY_RECORD_SIZE 13
+
+// Encode readings in the configured format. Like snprintf, returns the length needed even if it exceeds size.
+int telemetry_encode(const reading_t *readings, size_t count, char *payload, size_t size);
+
+// Topic the configured format publishes readings to
+const char *telemetry_topic(void);
+
+// Level events are rare enough that they are always JSON, on CONFIG_PUBLISH_LEVEL_EVENT_TOPIC
+int telemetry_encode_event(const level_event_t *event, char *payload, size_t size);
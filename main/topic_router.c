@@ -0,0 +1,54 @@
+#include "topic_router.h"
+
+#include "esp_log.h"
+#include <string.h>
+
+typedef struct {
+    const char *topic;
+    size_t topic_len;
+    int qos;
+    topic_handler_t handler;
+} topic_route_t;
+
+static const char *TAG = "TOPIC_ROUTER";
+
+static topic_route_t routes[TOPIC_ROUTER_MAX_ROUTES];
+static size_t route_count = 0;
+
+bool topic_router_register(const char *topic, int qos, topic_handler_t handler) {
+    if (route_count == TOPIC_ROUTER_MAX_ROUTES) {
+        ESP_LOGE(TAG, "No room to route topic %s", topic);
+        return false;
+    }
+    routes[route_count++] = (topic_route_t){
+        .topic = topic,
+        .topic_len = strlen(topic),
+        .qos = qos,
+        .handler = handler,
+    };
+    return true;
+}
+
+void topic_router_subscribe_all(esp_mqtt_client_handle_t client) {
+    for (size_t i = 0; i < route_count; i++) {
+        int msg_id = esp_mqtt_client_subscribe(client, routes[i].topic, routes[i].qos);
+        ESP_LOGI(TAG, "Subscribed to topic %s, msg_id=%d", routes[i].topic, msg_id);
+    }
+}
+
+topic_route_result_t topic_router_dispatch(esp_mqtt_event_handle_t event) {
+    // Continuation chunks of a message larger than the MQTT buffer carry no topic
+    if (event->current_data_offset != 0 || event->data_len != event->total_data_len) {
+        ESP_LOGW(TAG, "Dropping fragmented message (%d of %d bytes)", event->data_len, event->total_data_len);
+        return TOPIC_ROUTE_DROPPED;
+    }
+
+    for (size_t i = 0; i < route_count; i++) {
+        if ((size_t)event->topic_len == routes[i].topic_len &&
+            memcmp(event->topic, routes[i].topic, routes[i].topic_len) == 0) {
+            routes[i].handler(event);
+            return TOPIC_ROUTE_HANDLED;
+        }
+    }
+    return TOPIC_ROUTE_UNROUTED;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "mqtt_client.h"
+
+#define TOPIC_ROUTER_MAX_ROUTES 8
+
+typedef void (*topic_handler_t)(esp_mqtt_event_handle_t event);
+
+typedef enum {
+    TOPIC_ROUTE_HANDLED,
+    TOPIC_ROUTE_UNROUTED, // No route matches the topic
+    TOPIC_ROUTE_DROPPED,  // A fragment of a message larger than the MQTT buffer; never reaches a handler
+} topic_route_result_t;
+
+// Route messages on topic to handler. The topic string must outlive the registration.
+bool topic_router_register(const char *topic, int qos, topic_handler_t handler);
+
+// Subscribe the client to every registered topic, e.g. after (re)connecting
+void topic_router_subscribe_all(esp_mqtt_client_handle_t client);
+
+// Hand an MQTT_EVENT_DATA to the handler whose topic matches exactly. Fragmented messages are dropped.
+topic_route_result_t topic_router_dispatch(esp_mqtt_event_handle_t event);
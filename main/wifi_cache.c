@@ -0,0 +1,185 @@
+#include "wifi_cache.h"
+
+#include "esp_attr.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "gecl-wifi-manager.h"
+
+#include "metrics.h"
+
+#define WIFI_CACHE_MAGIC 0x57574331 // "WWC1"
+#define WIFI_CACHE_NVS_NAMESPACE "wificache"
+#define WIFI_CACHE_NVS_KEY "ap"
+#define WIFI_CACHE_MAX_MISSES 2 // Failed associations on the cached AP before scanning normally again
+
+static const char *TAG = "WIFI_CACHE";
+
+typedef struct {
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t crc;
+} wifi_cache_t;
+
+// Survives deep sleep and software resets; NVS holds a copy for cold boots
+static RTC_NOINIT_ATTR wifi_cache_t cache;
+
+static bool pinned = false;        // Driver config currently carries the cached BSSID and channel
+static uint32_t misses = 0;        // Disconnects since the last IP address
+static int64_t disconnect_us = 0;  // Start of the current outage, 0 while connected
+
+static uint32_t cache_crc(const wifi_cache_t *c) {
+    return esp_rom_crc32_le(0, (const uint8_t *)c, offsetof(wifi_cache_t, crc));
+}
+
+static bool cache_valid(void) {
+    return cache.magic == WIFI_CACHE_MAGIC && cache.crc == cache_crc(&cache) && cache.channel != 0;
+}
+
+static void load_from_nvs(void) {
+    nvs_handle_t handle;
+    size_t size = sizeof(cache);
+
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, WIFI_CACHE_NVS_KEY, &cache, &size) != ESP_OK || size != sizeof(cache)) {
+        cache.magic = 0;
+    }
+    nvs_close(handle);
+}
+
+static void save_to_nvs(void) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, WIFI_CACHE_NVS_KEY, &cache, sizeof(cache));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save AP to NVS: %s", esp_err_to_name(err));
+    }
+}
+
+// Point the driver at the cached AP, or back at a full scan. Refused while an association is in flight.
+static void set_pinned(bool pin) {
+    wifi_config_t config;
+
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK) {
+        return;
+    }
+    if (pin && strncmp((const char *)config.sta.ssid, cache.ssid, sizeof(config.sta.ssid)) != 0) {
+        return; // Cached for a different network; provisioning changed the SSID
+    }
+
+    config.sta.channel = pin ? cache.channel : 0;
+    config.sta.bssid_set = pin;
+    if (pin) {
+        memcpy(config.sta.bssid, cache.bssid, sizeof(config.sta.bssid));
+    }
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &config);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Driver config not updated: %s", esp_err_to_name(err));
+        return;
+    }
+    pinned = pin;
+    if (pin) {
+        ESP_LOGI(TAG, "Associating with cached AP on channel %u", cache.channel);
+    } else {
+        ESP_LOGW(TAG, "Cached AP unreachable, falling back to a full scan");
+    }
+}
+
+static void remember_ap(void) {
+    wifi_ap_record_t ap;
+    wifi_config_t config;
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK) {
+        return;
+    }
+    if (cache_valid() && cache.channel == ap.primary && memcmp(cache.bssid, ap.bssid, sizeof(cache.bssid)) == 0 &&
+        strncmp(cache.ssid, (const char *)config.sta.ssid, sizeof(cache.ssid) - 1) == 0) {
+        return; // Unchanged; don't spend a flash write
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = WIFI_CACHE_MAGIC;
+    strncpy(cache.ssid, (const char *)config.sta.ssid, sizeof(cache.ssid) - 1);
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+    cache.crc = cache_crc(&cache);
+    save_to_nvs();
+    ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %u", cache.bssid[0], cache.bssid[1],
+             cache.bssid[2], cache.bssid[3], cache.bssid[4], cache.bssid[5], cache.channel);
+}
+
+// Runs on the default event loop task, alongside the Wi-Fi manager's own handlers
+static void wifi_cache_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (disconnect_us == 0) {
+            disconnect_us = esp_timer_get_time();
+        }
+        misses++;
+        if (pinned && misses >= WIFI_CACHE_MAX_MISSES) {
+            set_pinned(false);
+        } else if (!pinned && misses == 1 && cache_valid()) {
+            set_pinned(true);
+        }
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        uint32_t boot_ms;
+
+        if (disconnect_us != 0) {
+            metrics_observe(METRIC_HIST_WIFI_RECONNECT_MS, (esp_timer_get_time() - disconnect_us) / 1000);
+        }
+        if (metrics_mark(METRIC_MARK_WIFI_UP, &boot_ms)) {
+            ESP_LOGI(TAG, "Boot to IP address: %lu ms", (unsigned long)boot_ms);
+        }
+        disconnect_us = 0;
+        misses = 0;
+        remember_ap();
+    }
+}
+
+esp_err_t wifi_cache_init(void) {
+    if (!cache_valid()) {
+        load_from_nvs();
+    }
+    if (!cache_valid()) {
+        memset(&cache, 0, sizeof(cache));
+    }
+
+    esp_err_t err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_cache_event_handler, NULL);
+    if (err == ESP_OK) {
+        err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_cache_event_handler, NULL);
+    }
+
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (wifi_active()) {
+        // init_wifi() waited for the association; it is only worth caching for next time
+        if (metrics_mark(METRIC_MARK_WIFI_UP, NULL)) {
+            remember_ap();
+        }
+    } else if (cache_valid()) {
+        // Refused if init_wifi() is already associating; the hint then applies on the next reconnect
+        set_pinned(true);
+    }
+    return ESP_OK;
+}
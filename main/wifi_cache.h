@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+
+/*
+ * Remembers the access point (BSSID and channel) of the last association in RTC memory, mirrored to NVS for
+ * power loss, and hands it to the Wi-Fi driver so re-associating skips the full scan. Falls back to a normal
+ * scan if the remembered AP stops answering. Also times station reconnects for the metrics report.
+ *
+ * Call right after init_wifi(), once the default event loop and the driver exist.
+ */
+esp_err_t wifi_cache_init(void);
@@ -3,8 +3,8 @@
 PROFILE="tennis@gamename"
 REGION="us-east-1"
 
-DINING_MAC="dc:da:0c:c1:bb:14"
-LIVING_MAC="30:30:f9:fb:8c:8c"
+# Only bowls already provisioned can boot the shared image
+BOWL_LIST="$(dirname "$0")/../provision/provisioned_bowls.txt"
 
 BUCKET="gamename-iot-ota"
 
@@ -35,12 +35,30 @@ get_latest_firmware_dir() {
 LATEST=$(get_latest_firmware_dir $BUCKET)
 echo "Latest firmware directory: $LATEST"
 
-aws iot-data publish \
-    --profile "${PROFILE}" \
-    --region "${REGION}" \
-    --endpoint-url "${IOT_URL}" \
-    --topic "${IOT_TOPIC}" \
-    --cli-binary-format raw-in-base64-out \
-    --payload \
-      "{\"${DINING_MAC}\": \"https://${BUCKET}.s3.${REGION}.amazonaws.com/home/dining-room/water-bowl/${LATEST}/firmware.bin\",
-        \"${LIVING_MAC}\": \"https://${BUCKET}.s3.${REGION}.amazonaws.com/home/living-room/water-bowl/${LATEST}/firmware.bin\"}"
+# One image serves every bowl; each one's identity lives in its prov partition. Fetch and hash it once.
+URL="https://${BUCKET}.s3.${REGION}.amazonaws.com/home/water-bowl/${LATEST}/firmware.bin"
+IMAGE=$(mktemp)
+trap 'rm -f "${IMAGE}"' EXIT
+curl -sSf -o "${IMAGE}" "${URL}" || exit 1
+SIZE=$(wc -c < "${IMAGE}" | tr -d ' ')
+SHA256=$(shasum -a 256 "${IMAGE}" | awk '{print $1}')
+
+# Publish a compact manifest on one bowl's own topic (<IOT_TOPIC>/<mac without colons>),
+# so each bowl only ever parses its own entry. Retained, so a bowl in deep sleep finds it on
+# its next connected wake; a bowl already running the version skips it.
+publish_manifest() {
+  DEVICE_ID=$1
+
+  aws iot-data publish \
+      --profile "${PROFILE}" \
+      --region "${REGION}" \
+      --endpoint-url "${IOT_URL}" \
+      --topic "${IOT_TOPIC}/${DEVICE_ID}" \
+      --retain \
+      --cli-binary-format raw-in-base64-out \
+      --payload "{\"url\": \"${URL}\", \"size\": ${SIZE}, \"sha256\": \"${SHA256}\", \"version\": \"${LATEST}\"}"
+}
+
+for DEVICE_ID in $(awk '!/^#/ && NF {print $1}' "${BOWL_LIST}"); do
+  publish_manifest "${DEVICE_ID}"
+done
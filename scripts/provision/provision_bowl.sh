@@ -0,0 +1,95 @@
+#!/bin/bash
+
+#
+# Write one bowl's identity to its "prov" partition, so the same firmware.bin runs on every bowl.
+#
+# Example usage:
+# provision_bowl.sh living-room main/certs/original/living-room-certificate.pem \
+#     main/certs/original/living-room-private.pem.key /dev/ttyUSB0
+#
+# The hostname is <location>-<last six hex digits of the MAC> unless HOSTNAME_OVERRIDE is set.
+#
+# Optional overrides (anything unset falls back to the firmware's Kconfig defaults):
+#   IOT_ENDPOINT, LEVEL_TOPIC, LED_TOPIC, OTA_TOPIC, OTA_GROUP, CONFIG_TOPIC
+#
+# Bowls whose partition table predates the prov partition need one serial flash of the full image first
+# (idf.py flash), then this script. Once provisioned, the bowl is added to provisioned_bowls.txt, which is the
+# list OTA manifests are published to; commit it.
+#
+
+if [ "$#" -lt 3 ] || [ "$#" -gt 4 ]; then
+    echo "Usage: $0 <location> <certificate.pem> <private.pem.key> [serial port]"
+    exit 1
+fi
+
+if [ -z "$IDF_PATH" ]; then
+    echo "IDF_PATH is not set; run . \$IDF_PATH/export.sh first"
+    exit 1
+fi
+
+LOCATION="$1"
+CERT_FILE="$2"
+KEY_FILE="$3"
+PORT="${4:-/dev/ttyUSB0}"
+
+PARTITION_SIZE=0x6000
+BOWL_LIST="$(dirname "$0")/provisioned_bowls.txt"
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+for f in "${CERT_FILE}" "${KEY_FILE}"; do
+    if [ ! -f "$f" ]; then
+        echo "No such file: $f"
+        exit 1
+    fi
+done
+
+DEVICE_ID=$(python -m esptool --port "${PORT}" read_mac | awk '/^MAC:/ {print $2; exit}' | tr -d ':' | tr '[:upper:]' '[:lower:]')
+if [ -z "${DEVICE_ID}" ]; then
+    echo "Could not read the MAC of the bowl on ${PORT}"
+    exit 1
+fi
+
+# Every bowl on the network needs its own name; the Kconfig default is the same for all of them
+HOSTNAME_VALUE="${HOSTNAME_OVERRIDE:-${LOCATION}-${DEVICE_ID: -6}}"
+if [ "${#HOSTNAME_VALUE}" -gt 31 ]; then
+    echo "Hostname ${HOSTNAME_VALUE} is longer than 31 characters; set HOSTNAME_OVERRIDE"
+    exit 1
+fi
+
+# Add a string entry only if a value was given
+optional_entry() {
+    local key=$1
+    local value=$2
+
+    if [ -n "$value" ]; then
+        echo "${key},data,string,${value}"
+    fi
+}
+
+{
+    echo "key,type,encoding,value"
+    echo "prov,namespace,,"
+    echo "location,data,string,${LOCATION}"
+    echo "hostname,data,string,${HOSTNAME_VALUE}"
+    optional_entry endpoint "${IOT_ENDPOINT}"
+    optional_entry level_topic "${LEVEL_TOPIC}"
+    optional_entry led_topic "${LED_TOPIC}"
+    optional_entry ota_topic "${OTA_TOPIC}"
+    optional_entry ota_group "${OTA_GROUP}"
+    optional_entry config_topic "${CONFIG_TOPIC}"
+    echo "cert,file,string,$(realpath "${CERT_FILE}")"
+    echo "key,file,string,$(realpath "${KEY_FILE}")"
+} > "${WORK_DIR}/prov.csv"
+
+python "${IDF_PATH}/components/nvs_flash/nvs_partition_generator/nvs_partition_gen.py" generate \
+    "${WORK_DIR}/prov.csv" "${WORK_DIR}/prov.bin" "${PARTITION_SIZE}" || exit 1
+
+python "${IDF_PATH}/components/partition_table/parttool.py" --port "${PORT}" \
+    write_partition --partition-name prov --input "${WORK_DIR}/prov.bin" || exit 1
+
+if ! grep -q "^${DEVICE_ID} " "${BOWL_LIST}"; then
+    echo "${DEVICE_ID} ${LOCATION}" >> "${BOWL_LIST}"
+fi
+
+echo "Provisioned ${LOCATION} as ${HOSTNAME_VALUE} (${DEVICE_ID}) on ${PORT}"